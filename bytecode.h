@@ -0,0 +1,514 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "parser.h"
+#include "interpreter.h"
+
+// Bytecode compiler and register VM for the trees built by parser.h, with
+// the same semantics as Interpreter (see interpreter.h).
+//
+// Every value lives in a register. The register file is laid out as
+//
+//     [variables: slotCount][temporaries][constants]
+//
+// so a variable operand is its Node::slot, and each distinct literal gets
+// a register that is filled once before the program starts. Expressions
+// therefore compile to one instruction per operator, with no loads.
+//
+// Conditions of if and while compile to jumps, not values: a comparison
+// becomes one fused compare-and-branch instruction, and && and || become
+// chains of such jumps that skip their right operand. Loops test their
+// condition at the bottom, so an iteration costs one branch.
+
+// Dispatch uses GCC's labels-as-values where available; define
+// VM_SWITCH_DISPATCH to force the portable switch loop
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+enum Opcode : uint8_t
+{
+    OP_MOVE,   // r[a] = r[b]
+    OP_ADD,    // r[a] = r[b] + r[c]
+    OP_SUB,    // r[a] = r[b] - r[c]
+    OP_MUL,    // r[a] = r[b] * r[c]
+    OP_DIV,    // r[a] = r[b] / r[c]
+    OP_LT,     // r[a] = r[b] < r[c]
+    OP_LE,     // r[a] = r[b] <= r[c]
+    OP_GT,     // r[a] = r[b] > r[c]
+    OP_GE,     // r[a] = r[b] >= r[c]
+    OP_EQ,     // r[a] = r[b] == r[c]
+    OP_NE,     // r[a] = r[b] != r[c]
+    OP_JUMP,   // goto a
+    OP_JZ,     // if (r[b] == 0) goto a
+    OP_JNZ,    // if (r[b] != 0) goto a
+    OP_JLT,    // if (r[b] < r[c]) goto a
+    OP_JLE,    // if (r[b] <= r[c]) goto a
+    OP_JGT,    // if (r[b] > r[c]) goto a
+    OP_JGE,    // if (r[b] >= r[c]) goto a
+    OP_JEQ,    // if (r[b] == r[c]) goto a
+    OP_JNE,    // if (r[b] != r[c]) goto a
+    OP_RETURN, // finish with r[b]
+};
+
+// Operand a is a destination register or jump target; b and c are always
+// source registers.
+struct Instruction
+{
+    Opcode op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+struct Bytecode
+{
+    std::vector<Instruction> code;
+    std::vector<size_t> offsets;    // Source offset of each instruction, for runtime errors
+    std::vector<int64_t> constants; // Initial values of the constant registers
+    uint32_t slotCount;
+    uint32_t constantBase;          // First constant register
+    RunStatus status;               // RUN_OK, or why the program could not be compiled
+    size_t failedAt;
+};
+
+class Compiler
+{
+public:
+    // Nesting cap, as in Interpreter, since compilation recurses over the tree
+    static constexpr int MAX_DEPTH = Interpreter::MAX_DEPTH;
+
+    Compiler(const ParseResult &program) : program(program), temporaries(0), nextTemporary(0), depth(0) {}
+
+    Bytecode compile()
+    {
+        result = Bytecode{{}, {}, {}, program.slotCount, 0, RUN_OK, 0};
+        if (!program.ok())
+        {
+            result.status = RUN_SYNTAX_ERROR;
+            result.failedAt = program.diagnostics.front().offset;
+            return result;
+        }
+        nextTemporary = program.slotCount;
+        temporaries = program.slotCount;
+        for (const Node *statement = program.root->first; statement; statement = statement->next)
+        {
+            statementCode(statement);
+        }
+        emit(OP_RETURN, 0, constant(0), 0, program.root);
+
+        // Constants were numbered on their own while temporaries were still
+        // being counted; move them above the temporaries now
+        result.constantBase = temporaries;
+        for (Instruction &instruction : result.code)
+        {
+            instruction.b = relocate(instruction.b);
+            instruction.c = relocate(instruction.c);
+        }
+        return result;
+    }
+
+private:
+    static constexpr uint32_t CONSTANT = 0x80000000; // Tags a constant index before relocation
+
+    const ParseResult &program;
+    Bytecode result;
+    std::unordered_map<int64_t, uint32_t> constantIndex;
+    uint32_t temporaries;   // One past the highest register used so far
+    uint32_t nextTemporary; // Temporaries are allocated as a stack within a statement
+    int depth;
+
+    uint32_t relocate(uint32_t operand) const
+    {
+        return operand & CONSTANT ? result.constantBase + (operand & ~CONSTANT) : operand;
+    }
+
+    uint32_t constant(int64_t value)
+    {
+        auto inserted = constantIndex.emplace(value, uint32_t(result.constants.size()));
+        if (inserted.second)
+        {
+            result.constants.push_back(value);
+        }
+        return inserted.first->second | CONSTANT;
+    }
+
+    uint32_t temporary()
+    {
+        temporaries = std::max(temporaries, nextTemporary + 1);
+        return nextTemporary++;
+    }
+
+    size_t emit(Opcode op, uint32_t a, uint32_t b, uint32_t c, const Node *node)
+    {
+        result.code.push_back(Instruction{op, a, b, c});
+        result.offsets.push_back(node->token.offset);
+        return result.code.size() - 1;
+    }
+
+    uint32_t here() const
+    {
+        return uint32_t(result.code.size());
+    }
+
+    void patch(const std::vector<size_t> &jumps)
+    {
+        for (size_t jump : jumps)
+        {
+            result.code[jump].a = here();
+        }
+    }
+
+    bool enter(const Node *node)
+    {
+        if (depth == MAX_DEPTH)
+        {
+            if (result.status == RUN_OK)
+            {
+                result.status = RUN_TOO_DEEP;
+                result.failedAt = node->token.offset;
+            }
+            return false;
+        }
+        depth++;
+        return true;
+    }
+
+    void statementCode(const Node *node)
+    {
+        if (!enter(node))
+            return;
+        nextTemporary = program.slotCount;
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            for (const Node *statement = node->first; statement; statement = statement->next)
+            {
+                statementCode(statement);
+            }
+            break;
+        case N_DECLARATION:
+            emit(OP_MOVE, node->slot, constant(0), 0, node);
+            break;
+        case N_ASSIGNMENT:
+            expressionCode(node->first, node->slot);
+            break;
+        case N_IF:
+        {
+            std::vector<size_t> toElse;
+            branchCode(node->first, false, toElse);
+            statementCode(node->second);
+            if (node->third)
+            {
+                size_t toEnd = emit(OP_JUMP, 0, 0, 0, node);
+                patch(toElse);
+                statementCode(node->third);
+                patch({toEnd});
+            }
+            else
+            {
+                patch(toElse);
+            }
+            break;
+        }
+        case N_WHILE:
+        {
+            size_t toCondition = emit(OP_JUMP, 0, 0, 0, node);
+            uint32_t body = here();
+            statementCode(node->second);
+            patch({toCondition});
+            std::vector<size_t> toBody;
+            branchCode(node->first, true, toBody);
+            for (size_t jump : toBody)
+            {
+                result.code[jump].a = body;
+            }
+            break;
+        }
+        case N_RETURN:
+            emit(OP_RETURN, 0, expressionCode(node->first), 0, node);
+            break;
+        default:
+            break;
+        }
+        depth--;
+    }
+
+    // Emits jumps, appended to jumps, that are taken when the truth of node
+    // equals when; otherwise execution falls through
+    void branchCode(const Node *node, bool when, std::vector<size_t> &jumps)
+    {
+        if (!enter(node))
+            return;
+        TokenType op = node->kind == N_BINARY ? node->token.type : T_EOF;
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            // a && b is true when both are; a || b is false when both are
+            bool both = op == T_LOGICAL_AND;
+            if (when == both)
+            {
+                std::vector<size_t> skip;
+                branchCode(node->first, !both, skip);
+                branchCode(node->second, both, jumps);
+                patch(skip);
+            }
+            else
+            {
+                branchCode(node->first, !both, jumps);
+                branchCode(node->second, !both, jumps);
+            }
+        }
+        else if (comparisonJump(op, when) != OP_RETURN)
+        {
+            Opcode jump = comparisonJump(op, when);
+            uint32_t mark = nextTemporary;
+            uint32_t left = expressionCode(node->first);
+            uint32_t right = expressionCode(node->second);
+            nextTemporary = mark;
+            jumps.push_back(emit(jump, 0, left, right, node));
+        }
+        else
+        {
+            uint32_t mark = nextTemporary;
+            uint32_t value = expressionCode(node);
+            nextTemporary = mark;
+            jumps.push_back(emit(when ? OP_JNZ : OP_JZ, 0, value, 0, node));
+        }
+        depth--;
+    }
+
+    // Fused branch taken when the comparison op has truth when, or
+    // OP_RETURN if op is not a comparison
+    static Opcode comparisonJump(TokenType op, bool when)
+    {
+        switch (op)
+        {
+        case T_LT:
+            return when ? OP_JLT : OP_JGE;
+        case T_LE:
+            return when ? OP_JLE : OP_JGT;
+        case T_GT:
+            return when ? OP_JGT : OP_JLE;
+        case T_GE:
+            return when ? OP_JGE : OP_JLT;
+        case T_EQ:
+        case T_EQUAL:
+            return when ? OP_JEQ : OP_JNE;
+        case T_NEQ:
+        case T_NOT_EQUAL:
+            return when ? OP_JNE : OP_JEQ;
+        default:
+            return OP_RETURN;
+        }
+    }
+
+    static Opcode arithmetic(TokenType op)
+    {
+        switch (op)
+        {
+        case T_PLUS:
+            return OP_ADD;
+        case T_MINUS:
+            return OP_SUB;
+        case T_MUL:
+            return OP_MUL;
+        case T_DIV:
+            return OP_DIV;
+        case T_LT:
+            return OP_LT;
+        case T_LE:
+            return OP_LE;
+        case T_GT:
+            return OP_GT;
+        case T_GE:
+            return OP_GE;
+        case T_EQ:
+        case T_EQUAL:
+            return OP_EQ;
+        default:
+            return OP_NE;
+        }
+    }
+
+    static constexpr uint32_t ANY = 0xFFFFFFFF;
+
+    // Returns the register holding the value of node. With a destination,
+    // the value is computed into that register instead.
+    uint32_t expressionCode(const Node *node, uint32_t destination = ANY)
+    {
+        if (!enter(node))
+            return constant(0);
+        uint32_t value;
+        if (node->kind == N_NUMBER || node->kind == N_IDENTIFIER)
+        {
+            value = node->kind == N_NUMBER ? constant(node->value) : node->slot;
+            if (destination != ANY)
+            {
+                emit(OP_MOVE, destination, value, 0, node);
+                value = destination;
+            }
+        }
+        else if (node->token.type == T_LOGICAL_AND || node->token.type == T_LOGICAL_OR)
+        {
+            value = destination != ANY ? destination : temporary();
+            std::vector<size_t> toFalse;
+            branchCode(node, false, toFalse);
+            emit(OP_MOVE, value, constant(1), 0, node);
+            size_t toEnd = emit(OP_JUMP, 0, 0, 0, node);
+            patch(toFalse);
+            emit(OP_MOVE, value, constant(0), 0, node);
+            patch({toEnd});
+        }
+        else
+        {
+            // Operands are done with once the operator has read them, so
+            // the result may reuse their temporaries
+            uint32_t mark = nextTemporary;
+            uint32_t left = expressionCode(node->first);
+            uint32_t right = expressionCode(node->second);
+            nextTemporary = mark;
+            value = destination != ANY ? destination : temporary();
+            emit(arithmetic(node->token.type), value, left, right, node);
+        }
+        depth--;
+        return value;
+    }
+};
+
+class VirtualMachine
+{
+public:
+    VirtualMachine(const Bytecode &program) : program(program) {}
+
+    RunResult run()
+    {
+        if (program.status != RUN_OK)
+        {
+            return RunResult{program.status, 0, program.failedAt};
+        }
+        registers.assign(program.constantBase, 0);
+        registers.insert(registers.end(), program.constants.begin(), program.constants.end());
+        return execute(program.code.data(), registers.data());
+    }
+
+    // Variable values after run(), indexed by Node::slot
+    std::vector<int64_t> slots() const
+    {
+        return std::vector<int64_t>(registers.begin(), registers.begin() + program.slotCount);
+    }
+
+private:
+    const Bytecode &program;
+    std::vector<int64_t> registers;
+
+    RunResult execute(const Instruction *code, int64_t *r)
+    {
+        const Instruction *pc = code;
+
+#ifdef VM_COMPUTED_GOTO
+        // Indexed by Opcode
+        static const void *const handlers[] = {
+            &&handle_OP_MOVE, &&handle_OP_ADD, &&handle_OP_SUB, &&handle_OP_MUL, &&handle_OP_DIV,
+            &&handle_OP_LT, &&handle_OP_LE, &&handle_OP_GT, &&handle_OP_GE, &&handle_OP_EQ, &&handle_OP_NE,
+            &&handle_OP_JUMP, &&handle_OP_JZ, &&handle_OP_JNZ,
+            &&handle_OP_JLT, &&handle_OP_JLE, &&handle_OP_JGT, &&handle_OP_JGE, &&handle_OP_JEQ, &&handle_OP_JNE,
+            &&handle_OP_RETURN,
+        };
+#define VM_CASE(op) handle_##op:
+#define VM_NEXT() goto *handlers[pc->op]
+        VM_NEXT();
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+        for (;;)
+        {
+            switch (pc->op)
+            {
+#endif
+
+#define VM_ARITHMETIC(name, expression) \
+    VM_CASE(name)                       \
+    {                                   \
+        int64_t x = r[pc->b];           \
+        int64_t y = r[pc->c];           \
+        r[pc->a] = (expression);        \
+        pc++;                           \
+        VM_NEXT();                      \
+    }
+#define VM_BRANCH(name, comparison)                            \
+    VM_CASE(name)                                              \
+    {                                                          \
+        pc = r[pc->b] comparison r[pc->c] ? code + pc->a : pc + 1; \
+        VM_NEXT();                                             \
+    }
+
+        VM_CASE(OP_MOVE)
+        {
+            r[pc->a] = r[pc->b];
+            pc++;
+            VM_NEXT();
+        }
+        VM_ARITHMETIC(OP_ADD, int64_t(uint64_t(x) + uint64_t(y)))
+        VM_ARITHMETIC(OP_SUB, int64_t(uint64_t(x) - uint64_t(y)))
+        VM_ARITHMETIC(OP_MUL, int64_t(uint64_t(x) * uint64_t(y)))
+        VM_CASE(OP_DIV)
+        {
+            int64_t x = r[pc->b];
+            int64_t y = r[pc->c];
+            if (y == 0)
+            {
+                return RunResult{RUN_DIVISION_BY_ZERO, 0, program.offsets[pc - code]};
+            }
+            r[pc->a] = y == -1 ? int64_t(0 - uint64_t(x)) : x / y;
+            pc++;
+            VM_NEXT();
+        }
+        VM_ARITHMETIC(OP_LT, x < y)
+        VM_ARITHMETIC(OP_LE, x <= y)
+        VM_ARITHMETIC(OP_GT, x > y)
+        VM_ARITHMETIC(OP_GE, x >= y)
+        VM_ARITHMETIC(OP_EQ, x == y)
+        VM_ARITHMETIC(OP_NE, x != y)
+        VM_CASE(OP_JUMP)
+        {
+            pc = code + pc->a;
+            VM_NEXT();
+        }
+        VM_CASE(OP_JZ)
+        {
+            pc = r[pc->b] == 0 ? code + pc->a : pc + 1;
+            VM_NEXT();
+        }
+        VM_CASE(OP_JNZ)
+        {
+            pc = r[pc->b] != 0 ? code + pc->a : pc + 1;
+            VM_NEXT();
+        }
+        VM_BRANCH(OP_JLT, <)
+        VM_BRANCH(OP_JLE, <=)
+        VM_BRANCH(OP_JGT, >)
+        VM_BRANCH(OP_JGE, >=)
+        VM_BRANCH(OP_JEQ, ==)
+        VM_BRANCH(OP_JNE, !=)
+        VM_CASE(OP_RETURN)
+        {
+            return RunResult{RUN_OK, r[pc->b], 0};
+        }
+
+#ifndef VM_COMPUTED_GOTO
+            }
+        }
+#endif
+#undef VM_BRANCH
+#undef VM_ARITHMETIC
+#undef VM_NEXT
+#undef VM_CASE
+    }
+};
+
+#endif
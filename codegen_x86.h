@@ -0,0 +1,713 @@
+#ifndef CODEGEN_X86_H
+#define CODEGEN_X86_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "parser.h"
+
+// Ahead-of-time x86-64 backend. Turns a tree from parser.h into GNU
+// assembler source (AT&T syntax, System V ABI) for one function
+//
+//     int SYMBOL(int64_t *out);
+//
+// which runs the program and returns 0 with the returned value in *out, or
+// 1 with the source offset of a division by zero in *out. Semantics follow
+// interpreter.h. With withMain, a main() that calls it and prints the
+// outcome through printf is appended, so the output links into a program
+// with a plain "gcc file.s".
+//
+// Variables are assigned to registers by linear scan. Each variable's live
+// interval runs from its first to its last mention in program order, and
+// is widened to cover any outermost loop it overlaps, since the back edge
+// keeps it alive there. A variable that may be read before it is written
+// (one first declared inside an if or loop, or first mentioned as a use)
+// is live from entry and zeroed in the prologue. When all eleven variable
+// registers are taken, the interval ending last is spilled to the frame.
+// rax, rcx and rdx are scratch for expressions.
+
+class X86Generator
+{
+public:
+    // Generation recurses over the tree, so nesting is capped as in Interpreter
+    static constexpr int MAX_DEPTH = 10000;
+
+    X86Generator(const ParseResult &program, std::string symbol = "lang_program")
+        : program(program), symbol(std::move(symbol)), failed(false), failedAt(0), depth(0), labels(0) {}
+
+    // Assembly for the program, or an empty string when it has syntax
+    // errors or is nested too deeply (see failure())
+    std::string generate(bool withMain)
+    {
+        out.clear();
+        if (!program.ok())
+        {
+            fail(program.diagnostics.front().offset);
+            return std::string();
+        }
+        number();
+        if (!failed)
+            allocate();
+        if (!failed)
+            function();
+        if (failed)
+            return std::string();
+        if (withMain)
+            mainFunction();
+        out += "\t.section .note.GNU-stack,\"\",@progbits\n";
+        return out;
+    }
+
+    bool ok() const
+    {
+        return !failed;
+    }
+
+    // Source offset of the syntax error or overly deep node that stopped generation
+    size_t failure() const
+    {
+        return failedAt;
+    }
+
+    // Variables kept in registers and in stack slots by the last generate()
+    uint32_t inRegisters() const
+    {
+        return registerCount;
+    }
+
+    uint32_t spilled() const
+    {
+        return spillCount;
+    }
+
+private:
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+    static constexpr int VARIABLE_REGISTERS = 11;
+    static constexpr int CALLEE_SAVED = 5; // The first five below must be preserved for the caller
+    static constexpr const char *registers64[VARIABLE_REGISTERS] = {
+        "%rbx", "%r12", "%r13", "%r14", "%r15", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11"};
+    static constexpr const char *registers32[VARIABLE_REGISTERS] = {
+        "%ebx", "%r12d", "%r13d", "%r14d", "%r15d", "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d"};
+
+    struct Interval
+    {
+        uint32_t slot;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    const ParseResult &program;
+    std::string symbol;
+    std::string out;
+    bool failed;
+    size_t failedAt;
+    int depth;
+    uint32_t labels;
+
+    // Numbering pass
+    uint32_t position;
+    int conditional; // Enclosing if arms and loop bodies
+    int loopDepth;
+    std::vector<uint32_t> firstMention;
+    std::vector<uint32_t> lastMention;
+    std::vector<uint8_t> fromEntry; // May be read before written
+    std::vector<const Node *> nameOf;
+    std::vector<std::pair<uint32_t, uint32_t>> outerLoops; // Position ranges, in order
+
+    // Allocation
+    std::vector<int> registerOf;    // Index into registers64, or -1 when spilled
+    std::vector<uint32_t> spillOf;  // Frame slot when spilled
+    uint32_t registerCount;
+    uint32_t spillCount;
+    bool calleeSavedUsed[CALLEE_SAVED];
+    int frameSize;
+
+    // Division-by-zero exits, emitted after the body: label and source offset
+    std::vector<std::pair<uint32_t, size_t>> divisionChecks;
+
+    void fail(size_t offset)
+    {
+        if (!failed)
+        {
+            failed = true;
+            failedAt = offset;
+        }
+    }
+
+    bool enter(const Node *node)
+    {
+        if (depth == MAX_DEPTH)
+        {
+            fail(node->token.offset);
+            return false;
+        }
+        depth++;
+        return true;
+    }
+
+    // Numbering: positions in program order, first and last mention of
+    // each variable, and the ranges of outermost loops
+
+    void number()
+    {
+        uint32_t slots = program.slotCount;
+        firstMention.assign(slots, NONE);
+        lastMention.assign(slots, 0);
+        fromEntry.assign(slots, 0);
+        nameOf.assign(slots, nullptr);
+        outerLoops.clear();
+        position = 1;
+        conditional = 0;
+        loopDepth = 0;
+        depth = 0;
+        for (const Node *statement = program.root->first; statement; statement = statement->next)
+            numberStatement(statement);
+    }
+
+    void mention(const Node *node, bool write)
+    {
+        uint32_t slot = node->slot;
+        uint32_t at = position++;
+        if (firstMention[slot] == NONE)
+        {
+            firstMention[slot] = at;
+            nameOf[slot] = node;
+            fromEntry[slot] = !write || conditional > 0;
+        }
+        lastMention[slot] = at;
+    }
+
+    void numberStatement(const Node *node)
+    {
+        if (!enter(node))
+            return;
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            for (const Node *statement = node->first; statement; statement = statement->next)
+                numberStatement(statement);
+            break;
+        case N_DECLARATION:
+            mention(node, true);
+            break;
+        case N_ASSIGNMENT:
+            numberExpression(node->first);
+            mention(node, true);
+            break;
+        case N_IF:
+            numberExpression(node->first);
+            conditional++;
+            numberStatement(node->second);
+            if (node->third)
+                numberStatement(node->third);
+            conditional--;
+            break;
+        case N_WHILE:
+        {
+            uint32_t start = position++;
+            loopDepth++;
+            conditional++;
+            numberExpression(node->first);
+            numberStatement(node->second);
+            conditional--;
+            loopDepth--;
+            uint32_t end = position++;
+            if (loopDepth == 0)
+                outerLoops.push_back({start, end});
+            break;
+        }
+        case N_RETURN:
+            numberExpression(node->first);
+            break;
+        default:
+            break;
+        }
+        depth--;
+    }
+
+    void numberExpression(const Node *node)
+    {
+        if (!enter(node))
+            return;
+        if (node->kind == N_IDENTIFIER)
+        {
+            mention(node, false);
+        }
+        else if (node->kind == N_BINARY)
+        {
+            numberExpression(node->first);
+            numberExpression(node->second);
+        }
+        depth--;
+    }
+
+    // Linear scan over the live intervals
+
+    void allocate()
+    {
+        std::vector<Interval> intervals;
+        for (uint32_t slot = 0; slot < program.slotCount; slot++)
+        {
+            if (firstMention[slot] == NONE)
+                continue;
+            Interval interval{slot, fromEntry[slot] ? 0 : firstMention[slot], lastMention[slot]};
+
+            // Outermost loops are disjoint and sorted, so the ones this
+            // interval overlaps form one run
+            auto first = std::lower_bound(outerLoops.begin(), outerLoops.end(), interval.start,
+                                          [](const std::pair<uint32_t, uint32_t> &loop, uint32_t at) { return loop.second < at; });
+            for (auto loop = first; loop != outerLoops.end() && loop->first <= interval.end; ++loop)
+            {
+                interval.start = std::min(interval.start, loop->first);
+                interval.end = std::max(interval.end, loop->second);
+            }
+            intervals.push_back(interval);
+        }
+        std::sort(intervals.begin(), intervals.end(), [](const Interval &a, const Interval &b) {
+            return a.start < b.start || (a.start == b.start && a.slot < b.slot);
+        });
+
+        registerOf.assign(program.slotCount, -1);
+        spillOf.assign(program.slotCount, NONE);
+        registerCount = spillCount = 0;
+        std::vector<Interval> active; // Holding a register, sorted by end
+        std::vector<int> freeRegisters;
+        for (int r = VARIABLE_REGISTERS - 1; r >= 0; r--)
+            freeRegisters.push_back(r);
+
+        for (const Interval &interval : intervals)
+        {
+            while (!active.empty() && active.front().end < interval.start)
+            {
+                freeRegisters.push_back(registerOf[active.front().slot]);
+                active.erase(active.begin());
+            }
+            if (freeRegisters.empty())
+            {
+                // Spill whichever of the current and active intervals ends last
+                Interval &last = active.back();
+                if (last.end > interval.end)
+                {
+                    registerOf[interval.slot] = registerOf[last.slot];
+                    registerOf[last.slot] = -1;
+                    spillOf[last.slot] = spillCount++;
+                    active.pop_back();
+                    insertByEnd(active, interval);
+                }
+                else
+                {
+                    spillOf[interval.slot] = spillCount++;
+                }
+                continue;
+            }
+            registerOf[interval.slot] = freeRegisters.back();
+            freeRegisters.pop_back();
+            insertByEnd(active, interval);
+        }
+
+        for (bool &used : calleeSavedUsed)
+            used = false;
+        for (uint32_t slot = 0; slot < program.slotCount; slot++)
+        {
+            if (registerOf[slot] >= 0)
+            {
+                registerCount++;
+                if (registerOf[slot] < CALLEE_SAVED)
+                    calleeSavedUsed[registerOf[slot]] = true;
+            }
+        }
+        // Frame: out pointer, callee-saved registers, spill slots
+        frameSize = 8 * (1 + CALLEE_SAVED + int(spillCount));
+        frameSize = (frameSize + 15) & ~15;
+    }
+
+    static void insertByEnd(std::vector<Interval> &active, const Interval &interval)
+    {
+        auto at = std::upper_bound(active.begin(), active.end(), interval.end,
+                                   [](uint32_t end, const Interval &other) { return end < other.end; });
+        active.insert(at, interval);
+    }
+
+    // Emission
+
+    void emit(const std::string &instruction)
+    {
+        out += '\t';
+        out += instruction;
+        out += '\n';
+    }
+
+    uint32_t newLabel()
+    {
+        return labels++;
+    }
+
+    std::string label(uint32_t id) const
+    {
+        return ".L" + symbol + "_" + std::to_string(id);
+    }
+
+    void place(uint32_t id)
+    {
+        out += label(id) + ":\n";
+    }
+
+    std::string location(uint32_t slot) const
+    {
+        if (registerOf[slot] >= 0)
+            return registers64[registerOf[slot]];
+        return std::to_string(-8 * int(2 + CALLEE_SAVED + spillOf[slot])) + "(%rbp)";
+    }
+
+    void zero(uint32_t slot)
+    {
+        if (registerOf[slot] >= 0)
+        {
+            std::string name = registers32[registerOf[slot]];
+            emit("xorl " + name + ", " + name);
+        }
+        else
+        {
+            emit("movq $0, " + location(slot));
+        }
+    }
+
+    static bool fitsImmediate(int64_t value)
+    {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    // An operand usable directly as the source of an instruction, or empty
+    // when the node has to be computed first
+    std::string simpleOperand(const Node *node) const
+    {
+        if (node->kind == N_IDENTIFIER)
+            return location(node->slot);
+        if (node->kind == N_NUMBER && fitsImmediate(node->value))
+            return "$" + std::to_string(node->value);
+        return std::string();
+    }
+
+    void function()
+    {
+        uint32_t epilogue = newLabel();
+        uint32_t divisionByZero = newLabel();
+        divisionChecks.clear();
+
+        out += "\t.text\n";
+        out += "# Register allocation:\n";
+        for (uint32_t slot = 0; slot < program.slotCount; slot++)
+        {
+            if (nameOf[slot])
+                out += "#   " + std::string(program.text(nameOf[slot]->token)) + " -> " + location(slot) + "\n";
+        }
+        out += "\t.globl " + symbol + "\n";
+        out += "\t.type " + symbol + ", @function\n";
+        out += symbol + ":\n";
+        emit("pushq %rbp");
+        emit("movq %rsp, %rbp");
+        emit("subq $" + std::to_string(frameSize) + ", %rsp");
+        emit("movq %rdi, -8(%rbp)");
+        for (int r = 0; r < CALLEE_SAVED; r++)
+        {
+            if (calleeSavedUsed[r])
+                emit("movq " + std::string(registers64[r]) + ", " + std::to_string(-8 * (2 + r)) + "(%rbp)");
+        }
+        for (uint32_t slot = 0; slot < program.slotCount; slot++)
+        {
+            if (nameOf[slot] && fromEntry[slot])
+                zero(slot);
+        }
+
+        depth = 0;
+        for (const Node *statement = program.root->first; statement; statement = statement->next)
+            statementCode(statement, epilogue);
+        if (failed)
+            return;
+
+        // Running off the end returns 0
+        emit("xorl %eax, %eax");
+        emit("movq -8(%rbp), %rcx");
+        emit("movq %rax, (%rcx)");
+        emit("jmp " + label(epilogue));
+
+        for (const auto &check : divisionChecks)
+        {
+            place(check.first);
+            emit("movq $" + std::to_string(check.second) + ", %rax");
+            emit("jmp " + label(divisionByZero));
+        }
+        place(divisionByZero);
+        emit("movq -8(%rbp), %rcx");
+        emit("movq %rax, (%rcx)");
+        emit("movl $1, %eax");
+
+        place(epilogue);
+        for (int r = 0; r < CALLEE_SAVED; r++)
+        {
+            if (calleeSavedUsed[r])
+                emit("movq " + std::to_string(-8 * (2 + r)) + "(%rbp), " + registers64[r]);
+        }
+        emit("leave");
+        emit("ret");
+        out += "\t.size " + symbol + ", .-" + symbol + "\n";
+    }
+
+    void mainFunction()
+    {
+        out += "\t.section .rodata\n";
+        out += ".L" + symbol + "_returned:\n\t.string \"Program returned %ld\\n\"\n";
+        out += ".L" + symbol + "_failed:\n\t.string \"Runtime error: Division by zero at offset %ld\\n\"\n";
+        out += "\t.text\n\t.globl main\n\t.type main, @function\nmain:\n";
+        emit("pushq %rbp");
+        emit("movq %rsp, %rbp");
+        emit("subq $16, %rsp");
+        emit("leaq -8(%rbp), %rdi");
+        emit("call " + symbol);
+        emit("movl %eax, -12(%rbp)");
+        emit("movq -8(%rbp), %rsi");
+        emit("leaq .L" + symbol + "_returned(%rip), %rdi");
+        emit("leaq .L" + symbol + "_failed(%rip), %rcx");
+        emit("testl %eax, %eax");
+        emit("cmovnz %rcx, %rdi");
+        emit("xorl %eax, %eax");
+        emit("call printf@PLT");
+        emit("movl -12(%rbp), %eax");
+        emit("leave");
+        emit("ret");
+        out += "\t.size main, .-main\n";
+    }
+
+    void statementCode(const Node *node, uint32_t epilogue)
+    {
+        if (!enter(node))
+            return;
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            for (const Node *statement = node->first; statement; statement = statement->next)
+                statementCode(statement, epilogue);
+            break;
+        case N_DECLARATION:
+            zero(node->slot);
+            break;
+        case N_ASSIGNMENT:
+            expressionCode(node->first);
+            emit("movq %rax, " + location(node->slot));
+            break;
+        case N_IF:
+        {
+            uint32_t elseLabel = newLabel();
+            branchCode(node->first, false, elseLabel);
+            statementCode(node->second, epilogue);
+            if (node->third)
+            {
+                uint32_t end = newLabel();
+                emit("jmp " + label(end));
+                place(elseLabel);
+                statementCode(node->third, epilogue);
+                place(end);
+            }
+            else
+            {
+                place(elseLabel);
+            }
+            break;
+        }
+        case N_WHILE:
+        {
+            uint32_t body = newLabel();
+            uint32_t condition = newLabel();
+            emit("jmp " + label(condition));
+            place(body);
+            statementCode(node->second, epilogue);
+            place(condition);
+            branchCode(node->first, true, body);
+            break;
+        }
+        case N_RETURN:
+            expressionCode(node->first);
+            emit("movq -8(%rbp), %rcx");
+            emit("movq %rax, (%rcx)");
+            emit("xorl %eax, %eax");
+            emit("jmp " + label(epilogue));
+            break;
+        default:
+            break;
+        }
+        depth--;
+    }
+
+    // Condition code of a comparison operator (left cmp right), or null
+    static const char *conditionCode(TokenType op, bool when)
+    {
+        switch (op)
+        {
+        case T_LT:
+            return when ? "l" : "ge";
+        case T_LE:
+            return when ? "le" : "g";
+        case T_GT:
+            return when ? "g" : "le";
+        case T_GE:
+            return when ? "ge" : "l";
+        case T_EQ:
+        case T_EQUAL:
+            return when ? "e" : "ne";
+        case T_NEQ:
+        case T_NOT_EQUAL:
+            return when ? "ne" : "e";
+        default:
+            return nullptr;
+        }
+    }
+
+    // Leaves the left operand in rax and returns the right operand, which is
+    // rcx unless it could be used directly. The left operand is computed
+    // first, so the first of two failing divisions is the one reported.
+    std::string operandsCode(const Node *node)
+    {
+        std::string right = simpleOperand(node->second);
+        if (!right.empty())
+        {
+            expressionCode(node->first);
+            return right;
+        }
+        expressionCode(node->first);
+        emit("pushq %rax");
+        expressionCode(node->second);
+        emit("movq %rax, %rcx");
+        emit("popq %rax");
+        return "%rcx";
+    }
+
+    // Jumps to target when the truth of node equals when
+    void branchCode(const Node *node, bool when, uint32_t target)
+    {
+        if (!enter(node))
+            return;
+        TokenType op = node->kind == N_BINARY ? node->token.type : T_EOF;
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            bool both = op == T_LOGICAL_AND;
+            if (when == both)
+            {
+                uint32_t skip = newLabel();
+                branchCode(node->first, !both, skip);
+                branchCode(node->second, both, target);
+                place(skip);
+            }
+            else
+            {
+                branchCode(node->first, !both, target);
+                branchCode(node->second, !both, target);
+            }
+        }
+        else if (conditionCode(op, when))
+        {
+            std::string right = operandsCode(node);
+            emit("cmpq " + right + ", %rax");
+            emit(std::string("j") + conditionCode(op, when) + " " + label(target));
+        }
+        else
+        {
+            expressionCode(node);
+            emit("testq %rax, %rax");
+            emit(std::string(when ? "jnz " : "jz ") + label(target));
+        }
+        depth--;
+    }
+
+    // Computes node into rax
+    void expressionCode(const Node *node)
+    {
+        if (!enter(node))
+            return;
+        if (node->kind == N_NUMBER)
+        {
+            if (node->value == 0)
+                emit("xorl %eax, %eax");
+            else if (fitsImmediate(node->value))
+                emit("movq $" + std::to_string(node->value) + ", %rax");
+            else
+                emit("movabsq $" + std::to_string(node->value) + ", %rax");
+        }
+        else if (node->kind == N_IDENTIFIER)
+        {
+            emit("movq " + location(node->slot) + ", %rax");
+        }
+        else if (node->kind == N_BINARY)
+        {
+            binaryCode(node);
+        }
+        depth--;
+    }
+
+    void binaryCode(const Node *node)
+    {
+        TokenType op = node->token.type;
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            uint32_t isFalse = newLabel();
+            uint32_t end = newLabel();
+            branchCode(node, false, isFalse);
+            emit("movl $1, %eax");
+            emit("jmp " + label(end));
+            place(isFalse);
+            emit("xorl %eax, %eax");
+            place(end);
+            return;
+        }
+
+        std::string right = operandsCode(node);
+        if (const char *condition = conditionCode(op, true))
+        {
+            emit("cmpq " + right + ", %rax");
+            emit(std::string("set") + condition + " %al");
+            emit("movzbl %al, %eax");
+            return;
+        }
+        switch (op)
+        {
+        case T_PLUS:
+            emit("addq " + right + ", %rax");
+            break;
+        case T_MINUS:
+            emit("subq " + right + ", %rax");
+            break;
+        case T_MUL:
+            if (right[0] == '$')
+                emit("imulq " + right + ", %rax, %rax");
+            else
+                emit("imulq " + right + ", %rax");
+            break;
+        case T_DIV:
+        {
+            if (right != "%rcx")
+                emit("movq " + right + ", %rcx");
+            uint32_t zero = newLabel();
+            uint32_t negate = newLabel();
+            uint32_t end = newLabel();
+            divisionChecks.push_back({zero, node->token.offset});
+            emit("testq %rcx, %rcx");
+            emit("jz " + label(zero));
+            // INT64_MIN / -1 traps in idiv, and x / -1 is just -x
+            emit("cmpq $-1, %rcx");
+            emit("je " + label(negate));
+            emit("cqto");
+            emit("idivq %rcx");
+            emit("jmp " + label(end));
+            place(negate);
+            emit("negq %rax");
+            place(end);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+};
+
+#endif
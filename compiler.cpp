@@ -0,0 +1,322 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <unistd.h>
+#include "parser.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "codegen_x86.h"
+#include "source_file.h"
+
+using namespace std;
+
+// Compiles a program to x86-64 assembly for the GNU assembler. The output
+// includes a main() that prints what the program returns, so
+//
+//     compiler abc.txt -o abc.s && gcc abc.s -o abc && ./abc
+//
+// builds a native executable. The tree is optimized first unless
+// --no-optimize is given.
+//
+// --check is a differential test against the tree-walking Interpreter: it
+// compiles the given files, and with --random N also N generated programs,
+// links them all into one executable with gcc, runs it and compares every
+// outcome with the Interpreter's on the unoptimized tree.
+//
+// Usage: compiler [--no-optimize] [-o out.s] <abc.txt | ->
+//        compiler --check [--no-optimize] [--random N [seed]] [file...]
+
+// Random programs over more variables than there are registers, so the
+// allocator has to spill, with bounded loops so every program terminates.
+// Inner blocks redeclare names to exercise shadowing.
+class RandomProgram
+{
+public:
+    RandomProgram(uint64_t seed) : random(seed), loops(0) {}
+
+    string next()
+    {
+        string program;
+        for (char name = 'a'; name < 'a' + VARIABLES; name++)
+            program += string("int ") + name + ";\n";
+        int statements = pick(1, 10);
+        for (int i = 0; i < statements; i++)
+            program += statement(0) + "\n";
+        if (pick(0, 9) < 7)
+            program += "return " + expression(0) + ";\n";
+        return program;
+    }
+
+private:
+    static constexpr int VARIABLES = 14;
+
+    mt19937_64 random;
+    int loops;
+
+    int pick(int low, int high)
+    {
+        return uniform_int_distribution<int>(low, high)(random);
+    }
+
+    string variable()
+    {
+        return string(1, char('a' + pick(0, VARIABLES - 1)));
+    }
+
+    string expression(int depth)
+    {
+        static const char *operators[] = {"+", "-", "*", "/", ">", "<", "<=", ">=", "==", "!=", "&&", "||"};
+        static const char *numbers[] = {"0", "1", "2", "7", "100", "3000000000", "9223372036854775807"};
+        if (depth > 3 || pick(0, 99) < 35)
+            return pick(0, 2) ? variable() : numbers[pick(0, 6)];
+        if (pick(0, 99) < 15)
+            return "(" + expression(depth + 1) + ")";
+        return expression(depth + 1) + " " + operators[pick(0, 11)] + " " + expression(depth + 1);
+    }
+
+    string statement(int depth)
+    {
+        int kind = depth > 3 ? 30 : pick(0, 99);
+        if (kind < 10)
+        {
+            string name = variable();
+            return "{ int " + name + "; " + name + " = " + expression(0) + "; " + statement(depth + 1) + " }";
+        }
+        if (kind < 55)
+            return variable() + " = " + expression(0) + ";";
+        if (kind < 60)
+            return "if (" + expression(0) + ") return " + expression(0) + ";";
+        if (kind < 75)
+        {
+            string result = "if (" + expression(0) + ") " + statement(depth + 1);
+            if (pick(0, 1))
+                result += " else " + statement(depth + 1);
+            return result;
+        }
+        if (kind < 85)
+        {
+            string counter = "l" + to_string(++loops);
+            return "{ int " + counter + "; for (" + counter + " = 0; " + counter + " < " + to_string(pick(0, 5)) + "; " + counter + " = " + counter + " + 1) " + statement(depth + 1) + " }";
+        }
+        if (kind < 90)
+        {
+            string counter = "w" + to_string(++loops);
+            return "{ int " + counter + "; " + counter + " = 0; while (" + counter + " < " + to_string(pick(0, 4)) + " && (" + expression(1) + ")) { " + counter + " = " + counter + " + 1; " + statement(depth + 1) + " } }";
+        }
+        string block = "{ ";
+        int statements = pick(0, 3);
+        for (int i = 0; i < statements; i++)
+            block += statement(depth + 1) + " ";
+        return block + "}";
+    }
+};
+
+struct CheckCase
+{
+    string name;
+    string source;
+    string expected; // "status value" as printed by the check harness
+};
+
+static int check(const vector<CheckCase> &cases, bool optimizeTree)
+{
+    char directory[] = "/tmp/compiler-check-XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        cerr << "Error: cannot create a temporary directory" << endl;
+        return 1;
+    }
+    string base = directory;
+
+    ofstream assembly(base + "/programs.s");
+    ostringstream harness;
+    harness << "#include <stdio.h>\n";
+    for (size_t i = 0; i < cases.size(); i++)
+        harness << "int program_" << i << "(long long *out);\n";
+    harness << "static int (*programs[])(long long *) = {\n";
+    for (size_t i = 0; i < cases.size(); i++)
+        harness << "    program_" << i << ",\n";
+    harness << "};\n"
+               "int main(void)\n"
+               "{\n"
+               "    for (unsigned i = 0; i < sizeof programs / sizeof *programs; i++)\n"
+               "    {\n"
+               "        long long out = 0;\n"
+               "        int status = programs[i](&out);\n"
+               "        printf(\"%d %lld\\n\", status, out);\n"
+               "    }\n"
+               "    return 0;\n"
+               "}\n";
+    ofstream(base + "/main.c") << harness.str();
+
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        ParseResult program = parse(cases[i].source);
+        if (optimizeTree)
+            optimize(program);
+        assembly << X86Generator(program, "program_" + to_string(i)).generate(false);
+    }
+    assembly.close();
+
+    string binary = base + "/check";
+    string build = "gcc -o " + binary + " " + base + "/main.c " + base + "/programs.s";
+    int failures = 0;
+    if (system(build.c_str()) != 0)
+    {
+        cerr << "Error: assembling or linking failed, see " << base << endl;
+        return 1;
+    }
+    FILE *output = popen(binary.c_str(), "r");
+    char line[128];
+    size_t index = 0;
+    while (output && fgets(line, sizeof line, output))
+    {
+        string actual = line;
+        actual.pop_back();
+        if (index < cases.size() && actual != cases[index].expected)
+        {
+            failures++;
+            cout << "MISMATCH " << cases[index].name << ": interpreter " << cases[index].expected << ", native " << actual << endl;
+            cout << cases[index].source << endl;
+        }
+        index++;
+    }
+    if (!output || pclose(output) != 0 || index != cases.size())
+    {
+        cerr << "Error: the check program did not run to completion, see " << base << endl;
+        return 1;
+    }
+
+    remove((base + "/programs.s").c_str());
+    remove((base + "/main.c").c_str());
+    remove(binary.c_str());
+    rmdir(directory);
+    cout << cases.size() << " programs compared, " << failures << " mismatches" << endl;
+    return failures ? 1 : 0;
+}
+
+// Adds source as a case when the interpreter can run it and the backend can compile it
+static bool addCase(vector<CheckCase> &cases, const string &name, const string &source)
+{
+    ParseResult program = parse(source);
+    if (!program.ok() || !X86Generator(program).generate(false).size())
+        return false;
+    RunResult result = Interpreter(program).run();
+    if (result.status == RUN_OK)
+        cases.push_back(CheckCase{name, source, "0 " + to_string(result.value)});
+    else if (result.status == RUN_DIVISION_BY_ZERO)
+        cases.push_back(CheckCase{name, source, "1 " + to_string(result.offset)});
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    bool checkMode = false;
+    bool optimizeTree = true;
+    long randomCount = 0;
+    uint64_t seed = 1;
+    const char *outputName = nullptr;
+    vector<const char *> filenames;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--check")
+            checkMode = true;
+        else if (argument == "--no-optimize")
+            optimizeTree = false;
+        else if (argument == "--random" && i + 1 < argc)
+        {
+            randomCount = atol(argv[++i]);
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+                seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "-o" && i + 1 < argc)
+            outputName = argv[++i];
+        else
+            filenames.push_back(argv[i]);
+    }
+    if (checkMode)
+        usage = outputName || (filenames.empty() && randomCount == 0);
+    else
+        usage = randomCount || filenames.size() != 1;
+    if (usage)
+    {
+        cerr << "Usage: " << argv[0] << " [--no-optimize] [-o out.s] <abc.txt | ->" << endl;
+        cerr << "       " << argv[0] << " --check [--no-optimize] [--random N [seed]] [file...]" << endl;
+        return 1;
+    }
+
+    if (checkMode)
+    {
+        vector<CheckCase> cases;
+        for (const char *filename : filenames)
+        {
+            SourceFile source(filename);
+            if (!source.isOpen())
+            {
+                cerr << "Error: " << source.errorMessage() << endl;
+                return 1;
+            }
+            if (!addCase(cases, filename, string(source.text())))
+                cout << filename << ": skipped, it has syntax errors or nests too deeply" << endl;
+        }
+        RandomProgram generator(seed);
+        for (long i = 0; i < randomCount; i++)
+            addCase(cases, "random program " + to_string(i), generator.next());
+        return check(cases, optimizeTree);
+    }
+
+    SourceFile source(filenames[0]);
+    if (!source.isOpen())
+    {
+        cerr << "Error: " << source.errorMessage() << endl;
+        return 1;
+    }
+    ParseResult program = parse(source.text());
+    for (const Diagnostic &diagnostic : program.diagnostics)
+    {
+        cout << diagnostic.message << " at line " << diagnostic.location.line << ", column " << diagnostic.location.column << endl;
+    }
+    if (!program.ok())
+    {
+        return 1;
+    }
+    if (optimizeTree)
+    {
+        optimize(program);
+    }
+
+    X86Generator generator(program);
+    string assembly = generator.generate(true);
+    if (!generator.ok())
+    {
+        SourceLocation at = LineIndex(program.source).locate(generator.failure());
+        cout << "Error: nesting too deep at line " << at.line << ", column " << at.column << endl;
+        return 1;
+    }
+    if (outputName)
+    {
+        ofstream file(outputName);
+        file << assembly;
+        if (!file)
+        {
+            cerr << "Error: cannot write " << outputName << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cout << assembly;
+    }
+    return 0;
+}
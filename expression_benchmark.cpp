@@ -0,0 +1,267 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include "parser.h"
+
+// Compares Parser's precedence-climbing expression engine with the
+// five-level recursive chain it replaced (parseLogicalOr -> parseLogicalAnd
+// -> parseComparison -> parseTerm -> parseFactor, plus the +/- level the
+// chain was missing). Both read tokens through the same lookahead ring and
+// build the same AST, so the difference is the expression engine alone.
+//
+// Usage: expression_benchmark [statements] [operands per expression]
+
+using namespace std;
+
+// The old chain, kept here only as the baseline
+class ChainParser
+{
+public:
+    ChainParser(Lexer &lexer) : lexer(lexer), head(0), count(0) {}
+
+    ParseResult parseProgram()
+    {
+        Node *program = arena.make<Node>(N_PROGRAM, peek());
+        Node **tail = &program->first;
+        while (peek().type != T_EOF)
+        {
+            if (peek().type == T_INT)
+            {
+                expect(T_INT);
+                *tail = arena.make<Node>(N_DECLARATION, expect(T_ID));
+                expect(T_SEMICOLON);
+                tail = &(*tail)->next;
+                continue;
+            }
+            Node *assignment = arena.make<Node>(N_ASSIGNMENT, expect(T_ID));
+            expect(T_ASSIGN);
+            assignment->first = parseLogicalOr();
+            expect(T_SEMICOLON);
+            *tail = assignment;
+            tail = &assignment->next;
+        }
+        return ParseResult{move(arena), program, {}, lexer.source(), 0};
+    }
+
+private:
+    static constexpr size_t LOOKAHEAD = 4;
+    Lexer &lexer;
+    Token ring[LOOKAHEAD];
+    size_t head;
+    size_t count;
+    Arena arena;
+
+    const Token &peek(size_t k = 0)
+    {
+        while (count <= k)
+        {
+            ring[(head + count) & (LOOKAHEAD - 1)] = lexer.nextToken();
+            count++;
+        }
+        return ring[(head + k) & (LOOKAHEAD - 1)];
+    }
+
+    void advance()
+    {
+        peek();
+        head = (head + 1) & (LOOKAHEAD - 1);
+        count--;
+    }
+
+    Token expect(TokenType type)
+    {
+        if (peek().type != type)
+        {
+            cout << "Chain parser: unexpected " << lexer.text(peek()) << endl;
+            exit(1);
+        }
+        Token token = peek();
+        advance();
+        return token;
+    }
+
+    Node *binary(const Token &op, Node *left, Node *right)
+    {
+        Node *node = arena.make<Node>(N_BINARY, op);
+        node->first = left;
+        node->second = right;
+        return node;
+    }
+
+    Node *parseLogicalOr()
+    {
+        Node *left = parseLogicalAnd();
+        while (peek().type == T_LOGICAL_OR)
+        {
+            Token op = expect(peek().type);
+            left = binary(op, left, parseLogicalAnd());
+        }
+        return left;
+    }
+
+    Node *parseLogicalAnd()
+    {
+        Node *left = parseComparison();
+        while (peek().type == T_LOGICAL_AND)
+        {
+            Token op = expect(peek().type);
+            left = binary(op, left, parseComparison());
+        }
+        return left;
+    }
+
+    Node *parseComparison()
+    {
+        Node *left = parseArithmetic();
+        while (peek().type == T_EQUAL || peek().type == T_NOT_EQUAL ||
+               peek().type == T_GT || peek().type == T_LT ||
+               peek().type == T_LE || peek().type == T_GE)
+        {
+            Token op = expect(peek().type);
+            left = binary(op, left, parseArithmetic());
+        }
+        return left;
+    }
+
+    Node *parseArithmetic()
+    {
+        Node *left = parseTerm();
+        while (peek().type == T_PLUS || peek().type == T_MINUS)
+        {
+            Token op = expect(peek().type);
+            left = binary(op, left, parseTerm());
+        }
+        return left;
+    }
+
+    Node *parseTerm()
+    {
+        Node *left = parseFactor();
+        while (peek().type == T_MUL || peek().type == T_DIV)
+        {
+            Token op = expect(peek().type);
+            left = binary(op, left, parseFactor());
+        }
+        return left;
+    }
+
+    Node *parseFactor()
+    {
+        if (peek().type == T_NUM)
+            return arena.make<Node>(N_NUMBER, expect(T_NUM));
+        if (peek().type == T_ID)
+            return arena.make<Node>(N_IDENTIFIER, expect(T_ID));
+        expect(T_LPAREN);
+        Node *inner = parseLogicalOr();
+        expect(T_RPAREN);
+        return inner;
+    }
+};
+
+// Assignments whose right-hand sides are long arithmetic expressions with
+// occasional comparisons, logical operators and parentheses
+string makeProgram(int statements, int operands)
+{
+    static const char *arithmetic[] = {" + ", " - ", " * ", " / "};
+    static const char *other[] = {" > ", " <= ", " == ", " != ", " && ", " || "};
+    mt19937 rng(7);
+    string program;
+    for (int i = 0; i < 50; i++)
+        program += "int x" + to_string(i) + ";\n";
+    for (int i = 0; i < 100; i++)
+        program += "int v" + to_string(i) + ";\n";
+    for (int s = 0; s < statements; s++)
+    {
+        program += "x" + to_string(s % 50) + " = ";
+        int open = 0;
+        for (int i = 0; i < operands; i++)
+        {
+            if (i > 0)
+                program += rng() % 8 == 0 ? other[rng() % 6] : arithmetic[rng() % 4];
+            if (rng() % 10 == 0 && i + 1 < operands)
+            {
+                program += "(";
+                open++;
+            }
+            program += rng() % 2 ? "v" + to_string(rng() % 100) : to_string(rng() % 1000);
+            if (open > 0 && rng() % 4 == 0)
+            {
+                program += ")";
+                open--;
+            }
+        }
+        program += string(open, ')') + ";\n";
+    }
+    return program;
+}
+
+bool sameTree(const FlatAst &a, const FlatAst &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a.kind[i] != b.kind[i] || a.firstChild[i] != b.firstChild[i] ||
+            a.nextSibling[i] != b.nextSibling[i] || a.tokenOffset[i] != b.tokenOffset[i])
+            return false;
+    }
+    return true;
+}
+
+template <typename Run>
+double bestSeconds(Run run, int rounds)
+{
+    double best = 1e30;
+    for (int round = 0; round < rounds; round++)
+    {
+        auto start = chrono::steady_clock::now();
+        run();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int statements = argc > 1 ? atoi(argv[1]) : 2000;
+    int operands = argc > 2 ? atoi(argv[2]) : 500;
+    const int rounds = 10;
+    string program = makeProgram(statements, operands);
+
+    double lex = bestSeconds([&] {
+        Lexer lexer(program);
+        while (lexer.nextToken().type != T_EOF)
+        {
+        }
+    }, rounds);
+    double chain = bestSeconds([&] {
+        Lexer lexer(program);
+        ChainParser parser(lexer);
+        parser.parseProgram();
+    }, rounds);
+    double climbing = bestSeconds([&] {
+        Lexer lexer(program);
+        Parser parser(lexer);
+        parser.parseProgram();
+    }, rounds);
+
+    Lexer chainLexer(program), climbingLexer(program);
+    ChainParser chainParser(chainLexer);
+    Parser climbingParser(climbingLexer);
+    FlatAst chainAst = flatten(chainParser.parseProgram().root);
+    FlatAst climbingAst = flatten(climbingParser.parseProgram().root);
+    if (!sameTree(chainAst, climbingAst))
+    {
+        cout << "Parsers built different trees" << endl;
+        return 1;
+    }
+
+    cout << "input: " << program.size() / 1e6 << " MB, " << chainAst.size() << " nodes" << endl;
+    cout << "lex only:            " << lex * 1e3 << " ms" << endl;
+    cout << "chain (lex+parse):   " << chain * 1e3 << " ms, parse ~" << (chain - lex) * 1e3 << " ms" << endl;
+    cout << "climbing (lex+parse): " << climbing * 1e3 << " ms, parse ~" << (climbing - lex) * 1e3 << " ms" << endl;
+    cout << "parse speedup: " << (chain - lex) / (climbing - lex) << "x" << endl;
+    return 0;
+}
@@ -0,0 +1,1130 @@
+#ifndef INCREMENTAL_PARSER_H
+#define INCREMENTAL_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "parser.h"
+#include "parallel_lexer.h"
+
+// Text with a gap at the last edit, so typing in one place only copies
+// the bytes typed. Moving the gap elsewhere copies the bytes in between.
+class GapBuffer
+{
+public:
+    explicit GapBuffer(std::string text) : buffer(std::move(text)), gapStart(buffer.size()), gapEnd(buffer.size())
+    {
+        widen(0);
+    }
+
+    size_t size() const
+    {
+        return buffer.size() - (gapEnd - gapStart);
+    }
+
+    void replace(size_t offset, size_t deleted, std::string_view inserted)
+    {
+        moveGap(offset);
+        gapEnd += deleted;
+        if (gapEnd - gapStart < inserted.size())
+            widen(inserted.size());
+        if (!inserted.empty())
+            memcpy(&buffer[gapStart], inserted.data(), inserted.size());
+        gapStart += inserted.size();
+    }
+
+    // Bytes [from, to), moving the gap out of the way, whichever way is
+    // shorter, if it lies in between. Valid until the gap next moves.
+    std::string_view view(size_t from, size_t to)
+    {
+        if (from < gapStart && gapStart < to)
+            moveGap(gapStart - from < to - gapStart ? from : to);
+        return std::string_view(buffer.data() + (from < gapStart ? from : from + gapEnd - gapStart), to - from);
+    }
+
+    std::string_view all()
+    {
+        return view(0, size());
+    }
+
+private:
+    std::string buffer; // Bytes [gapStart, gapEnd) are not part of the text
+    size_t gapStart, gapEnd;
+
+    void moveGap(size_t offset)
+    {
+        if (offset < gapStart)
+        {
+            size_t count = gapStart - offset;
+            memmove(&buffer[gapEnd - count], &buffer[offset], count);
+            gapStart -= count;
+            gapEnd -= count;
+        }
+        else if (offset > gapStart)
+        {
+            size_t count = offset - gapStart;
+            memmove(&buffer[gapStart], &buffer[gapEnd], count);
+            gapStart += count;
+            gapEnd += count;
+        }
+    }
+
+    // Makes the gap at least length bytes, with room to spare in
+    // proportion to the text so that growing is amortized
+    void widen(size_t length)
+    {
+        size_t used = size();
+        size_t gap = length + used / 8 + 64;
+        std::string grown(used + gap, '\0');
+        memcpy(&grown[0], buffer.data(), gapStart);
+        memcpy(&grown[gapStart + gap], buffer.data() + gapEnd, buffer.size() - gapEnd);
+        buffer.swap(grown);
+        gapEnd = gapStart + gap;
+    }
+};
+
+// Keeps the tokens and tree of a source up to date as it is edited, e.g.
+// on every keystroke in an editor, with the same result as parse() on
+// the edited source but lexing and parsing only around the edit.
+//
+// Re-lexing starts at the end of the last token that ends before the
+// edit, since the Lexer never reads more than one character past a token,
+// and stops at the first new token past the inserted text that starts
+// where an old token did (shifted by the change in length). From there
+// on the old tokens are still right.
+//
+// The source is kept as a list of parts, each a run of top-level
+// statements of about PART_TOKENS tokens, parsed on its own with
+// top-level names deferred, like a segment of ParallelParser. A part
+// boundary is always a token where parse() would be at the top level and
+// not recovering from a syntax error, so a part parses the same on its
+// own as within the whole program. After an edit, parsing starts over at
+// the part that holds the token before the first change, since the parser
+// looks one token ahead. It goes on, splitting what it parses into new
+// parts, until it is out of the changed tokens and reaches the start of
+// an old part without recovering. The parts from there on are kept.
+//
+// Deferred slots are settled part by part against the top-level bindings
+// visible where the part starts (see SlotOrigin). Each name lists the
+// parts that bind it and the parts that looked it up, in program order,
+// and only the parts whose lookups now find a name bound differently are
+// settled again. A part keeps its slots as numbers from its base, the
+// slot number of its first new variable, or as references to a binding.
+//
+// A part's tokens, diagnostics and line starts are relative to where the
+// part starts. Like the text in its GapBuffer, the list of parts is split
+// at the last edit: the parts after it count their start back from the
+// end of the source, and their base back from the slot count, so an edit
+// moves neither. Moving the split to the next edit converts the parts in
+// between. result() moves the nodes of a part that moved and renumbers
+// those whose slot numbers changed; inserting a declaration at the top
+// renumbers every slot after it, which touches every node.
+//
+// Identifier ids no token uses any more are reused, so edit cost does
+// not grow with the edit history. The list of parts, about one per
+// PART_TOKENS tokens, is still an array of pointers that an edit splices.
+class IncrementalParser
+{
+public:
+    static constexpr size_t PART_TOKENS = 1024; // About one Arena block of nodes
+
+    explicit IncrementalParser(std::string source)
+        : text(std::move(source)), split(0), length(text.size()), epoch(0), slotCount(0), renumberFrom(SIZE_MAX), current{Arena(), nullptr, {}, {}, 0},
+          diagnosed(false)
+    {
+        TokenizedSource tokenized = ParallelLexer(text.all()).tokenize();
+        for (uint32_t id = 0; id < tokenized.identifiers.size(); id++)
+            names[intern(tokenized.identifiers.spelling(id))].tokens = 0;
+        for (const Token &token : tokenized.tokens)
+        {
+            if (token.type == T_ID)
+                names[token.id].tokens++;
+        }
+        current.root = current.arena.make<Node>(N_PROGRAM, tokenized.tokens.front());
+        Stream stream(*this, 0);
+        stream.tokens = std::move(tokenized.tokens);
+        update(0, 0, stream, tokenized.diagnostics, 0, 0, 0);
+    }
+
+    // Replaces deleted bytes at offset with inserted, as an editor would.
+    // An offset or length that runs past the end of the source stops at
+    // the end.
+    void edit(size_t offset, size_t deleted, std::string_view inserted)
+    {
+        offset = std::min(offset, text.size());
+        deleted = std::min(deleted, text.size() - offset);
+        divide(offset + deleted);
+        text.replace(offset, deleted, inserted);
+        size_t shift = inserted.size() - deleted; // Modulo 2^64
+
+        Position first = firstEndingAt(offset);
+        Position before = first;
+        size_t start = 0;
+        if (first.part > 0 || first.index > 0)
+        {
+            before = previous(first);
+            Token token = absolute(before);
+            start = token.offset + token.length;
+        }
+        Stream stream(*this, shift);
+        for (Position at{before.part, 0}; at != first; at = next(at))
+            stream.tokens.push_back(absolute(at));
+        std::vector<Diagnostic> lexed;
+        Position resume = relex(offset, deleted, inserted.size(), start, first, stream.tokens, lexed);
+        stream.resume(resume);
+        // The first old part that may line up starts at or after resume
+        size_t keep = std::max(resume.index == 0 ? resume.part : resume.part + 1, before.part + 1);
+        update(before.part, keep, stream, lexed, start, absolute(resume).offset, shift);
+    }
+
+    // Valid until the next edit
+    std::string_view source()
+    {
+        return text.all();
+    }
+
+    // Ending with T_EOF. Identifier ids are those the IncrementalParser
+    // keeps across edits, so they are not numbered as a single Lexer would.
+    std::vector<Token> tokens() const
+    {
+        std::vector<Token> all;
+        for (const std::unique_ptr<Part> &part : parts)
+        {
+            size_t start = startOf(*part);
+            for (Token token : part->tokens)
+            {
+                token.offset += start;
+                all.push_back(token);
+            }
+        }
+        return all;
+    }
+
+    // What parse(source()) would return: the tree, slots and diagnostics.
+    // The tree is owned by the IncrementalParser and valid until the next
+    // edit. Bringing its offsets and slots up to date takes time in
+    // proportion to the parts whose nodes edits moved or renumbered.
+    const ParseResult &result()
+    {
+        Node **tail = &current.root->first;
+        for (const std::unique_ptr<Part> &owned : parts)
+        {
+            Part &part = *owned;
+            if (part.nodesAt != startOf(part))
+                moveNodes(part);
+            if (part.renumber || startOf(part) >= renumberFrom)
+            {
+                for (size_t i = 0; i < part.local.size(); i++)
+                    part.parsed.named[i]->slot = slotOf(part, part.local[i]);
+                part.renumber = false;
+            }
+            if (part.parsed.statements)
+            {
+                *tail = part.parsed.statements;
+                tail = &part.last->next;
+            }
+        }
+        *tail = nullptr;
+        renumberFrom = SIZE_MAX;
+        current.root->token = absolute(Position{0, 0});
+        current.source = text.all();
+        current.slotCount = slotCount;
+        diagnostics();
+        return current;
+    }
+
+    // Same as result().diagnostics, without touching the tree. Takes time
+    // in proportion to the diagnostics and the number of parts.
+    const std::vector<Diagnostic> &diagnostics()
+    {
+        if (!diagnosed)
+            locateDiagnostics();
+        return current.diagnostics;
+    }
+
+private:
+    static constexpr uint32_t REFERENCE = 0x80000000; // A settled slot that is the visible binding of name id
+
+    struct Part;
+
+    // What a part that looks a name up finds bound there
+    enum Bound : uint8_t
+    {
+        UNBOUND,
+        IMPLICIT, // An undeclared name used at the top level
+        DECLARED,
+    };
+
+    // A part's last top-level binding of a name
+    struct Binding
+    {
+        Part *part;
+        uint32_t variable; // The part's own slot number
+        bool implicit;
+    };
+
+    // A part that looked a name up, and what it found
+    struct Use
+    {
+        Part *part;
+        Bound seen;
+    };
+
+    struct Name
+    {
+        std::string spelling;          // Empty while the id is free
+        uint32_t tokens;               // Tokens spelled so
+        std::vector<Binding> bindings; // By part start
+        std::vector<Use> uses;         // By part start
+    };
+
+    struct Write
+    {
+        uint32_t id;
+        uint32_t variable;
+        bool implicit;
+    };
+
+    struct Part
+    {
+        // As stored; see startOf() and baseOf()
+        size_t start; // 0 for the first part, else the offset of its first token
+        uint32_t base;
+        bool back; // Past the split: both counted back from the end
+        std::vector<Token> tokens;           // Offsets relative to the start; the last part's end with T_EOF
+        std::vector<uint32_t> lines;         // Offsets relative to the start just past each newline before the next part
+        std::vector<Diagnostic> lexerErrors; // Offsets relative to the start
+        ParsedPart parsed;                   // Error and slot name offsets relative to the start
+        Node *last;                          // Last statement, or null if there are none
+        std::vector<uint32_t> local;         // The part's own slot of each node in parsed.named
+        size_t nodesAt;                      // The start the nodes' offsets were last moved to
+        bool renumber;                       // Node slots are out of date
+        // Settled slots: the part's k-th new variable, or REFERENCE | id
+        std::vector<uint32_t> settled;
+        uint32_t fresh;                       // New variables
+        std::vector<Diagnostic> settleErrors; // Offsets relative to the start
+        std::vector<uint32_t> reads;          // Names looked up
+        std::vector<Write> writes;            // Names bound, as left at the end of the part
+        bool queued;                          // To be settled again
+    };
+
+    struct Position
+    {
+        size_t part, index;
+
+        bool operator!=(const Position &other) const
+        {
+            return part != other.part || index != other.index;
+        }
+    };
+
+    // The tokens an edit re-parses: those of the first part re-parsed up
+    // to the edit, the re-lexed ones, then the old ones from where lexing
+    // lined up again, moved by the change in length and read on demand
+    class Stream
+    {
+    public:
+        std::vector<Token> tokens; // Absolute offsets, as far as read
+
+        Stream(const IncrementalParser &owner, size_t shift) : owner(owner), shift(shift), old{0, 0}, ended(true) {}
+
+        void resume(Position at)
+        {
+            old = at;
+            ended = false;
+        }
+
+        // T_EOF past the end
+        Token operator[](size_t index)
+        {
+            while (index >= tokens.size() && !ended)
+            {
+                Token token = owner.absolute(old);
+                token.offset += shift;
+                tokens.push_back(token);
+                if (token.type == T_EOF)
+                    ended = true;
+                else
+                    old = owner.next(old);
+            }
+            return tokens[std::min(index, tokens.size() - 1)];
+        }
+
+        // Index of the token read at offset
+        size_t indexOf(size_t offset) const
+        {
+            return std::lower_bound(tokens.begin(), tokens.end(), offset, [](const Token &token, size_t offset) {
+                return token.offset < offset;
+            }) - tokens.begin();
+        }
+
+    private:
+        const IncrementalParser &owner;
+        size_t shift;
+        Position old; // Next old token to read
+        bool ended;
+    };
+
+    // A Stream as a parser's Source
+    class StreamReader
+    {
+    public:
+        StreamReader(Stream &stream, GapBuffer &buffer, size_t index) : stream(stream), buffer(buffer), index(index) {}
+
+        Token nextToken()
+        {
+            Token token = stream[index];
+            if (token.type != T_EOF)
+                index++;
+            return token;
+        }
+
+        std::string_view text(const Token &token)
+        {
+            return buffer.view(token.offset, token.offset + token.length);
+        }
+
+    private:
+        Stream &stream;
+        GapBuffer &buffer;
+        size_t index;
+    };
+
+    // Per name, while settling one part
+    struct Local
+    {
+        uint32_t epoch;    // Valid if the current one
+        uint32_t variable; // If own
+        Bound bound;
+        Bound seen; // Before the part
+        bool own;   // Bound by the part itself
+    };
+
+    // What the parts after some point see of a name
+    struct Outcome
+    {
+        uint32_t slot;
+        Bound bound;
+
+        bool operator!=(const Outcome &other) const
+        {
+            return slot != other.slot || bound != other.bound;
+        }
+    };
+
+    GapBuffer text;
+    std::vector<std::unique_ptr<Part>> parts;
+    size_t split;  // Parts from here on are counted back from the end
+    size_t length; // The end they count back from: the source size, but the old one during an edit
+    std::deque<Name> names; // By id
+    std::unordered_map<std::string_view, uint32_t> ids; // Keys are the spellings in names
+    std::vector<uint32_t> unused; // Free ids
+    std::vector<uint32_t> dead;   // Ids that lost their last token during this edit
+    std::vector<Local> scratch;   // By id
+    uint32_t epoch;
+    // Parts to settle again, by start
+    std::priority_queue<std::pair<size_t, Part *>, std::vector<std::pair<size_t, Part *>>, std::greater<std::pair<size_t, Part *>>> queue;
+    uint32_t slotCount;
+    size_t renumberFrom; // Parts from this offset on have out of date node slots too
+    ParseResult current; // Its arena only holds the N_PROGRAM node
+    bool diagnosed;      // current.diagnostics is up to date
+    std::vector<Node *> pending;
+
+    size_t startOf(const Part &part) const
+    {
+        return part.back ? length - part.start : part.start;
+    }
+
+    uint32_t baseOf(const Part &part) const
+    {
+        return part.back ? slotCount - part.base : part.base;
+    }
+
+    // Moves the split to the first part that starts at or after offset
+    void divide(size_t offset)
+    {
+        size_t to = std::lower_bound(parts.begin(), parts.end(), offset, [&](const std::unique_ptr<Part> &part, size_t offset) {
+            return startOf(*part) < offset;
+        }) - parts.begin();
+        for (; split > to; split--)
+        {
+            Part &part = *parts[split - 1];
+            part.start = length - part.start;
+            part.base = slotCount - part.base;
+            part.back = true;
+        }
+        for (; split < to; split++)
+        {
+            Part &part = *parts[split];
+            part.start = length - part.start;
+            part.base = slotCount - part.base;
+            part.back = false;
+        }
+    }
+
+    uint32_t intern(std::string_view spelling)
+    {
+        auto found = ids.find(spelling);
+        if (found != ids.end())
+        {
+            names[found->second].tokens++;
+            return found->second;
+        }
+        uint32_t id;
+        if (!unused.empty())
+        {
+            id = unused.back();
+            unused.pop_back();
+        }
+        else
+        {
+            id = uint32_t(names.size());
+            names.emplace_back();
+        }
+        Name &name = names[id];
+        name.spelling.assign(spelling.data(), spelling.size());
+        name.tokens = 1;
+        ids.emplace(name.spelling, id);
+        return id;
+    }
+
+    void release(uint32_t id)
+    {
+        if (--names[id].tokens == 0)
+            dead.push_back(id);
+    }
+
+    // Frees the ids that lost their last token and did not get another.
+    // No part binds or looks them up, since none has a token so spelled.
+    void reclaim()
+    {
+        for (uint32_t id : dead)
+        {
+            Name &name = names[id];
+            if (name.tokens == 0 && !name.spelling.empty())
+            {
+                ids.erase(name.spelling);
+                name.spelling.clear();
+                unused.push_back(id);
+            }
+        }
+        dead.clear();
+    }
+
+    Token absolute(Position at) const
+    {
+        const Part &part = *parts[at.part];
+        Token token = part.tokens[at.index];
+        token.offset += startOf(part);
+        return token;
+    }
+
+    Position next(Position at) const
+    {
+        if (at.index + 1 < parts[at.part]->tokens.size())
+            return Position{at.part, at.index + 1};
+        return Position{at.part + 1, 0};
+    }
+
+    Position previous(Position at) const
+    {
+        if (at.index > 0)
+            return Position{at.part, at.index - 1};
+        return Position{at.part - 1, parts[at.part - 1]->tokens.size() - 1};
+    }
+
+    // The first token that ends at or after offset. The one before the
+    // part holding offset can, if the part starts right after it.
+    Position firstEndingAt(size_t offset) const
+    {
+        size_t p = std::upper_bound(parts.begin(), parts.end(), offset, [&](size_t offset, const std::unique_ptr<Part> &part) {
+            return offset < startOf(*part);
+        }) - parts.begin() - 1;
+        if (p > 0)
+        {
+            Position last = previous(Position{p, 0});
+            Token token = absolute(last);
+            if (token.offset + token.length >= offset)
+                return last;
+        }
+        const std::vector<Token> &tokens = parts[p]->tokens;
+        size_t relative = offset - startOf(*parts[p]);
+        size_t index = std::lower_bound(tokens.begin(), tokens.end(), relative, [](const Token &token, size_t offset) {
+            return token.offset + token.length < offset;
+        }) - tokens.begin();
+        return index < tokens.size() ? Position{p, index} : Position{p + 1, 0};
+    }
+
+    // Lexes the new text from start, appending the tokens to out and the
+    // lexer diagnostics to lexed, until a token past the inserted text
+    // starts where an old token did, from first on. Returns that token.
+    //
+    // Lexes a window of the text, widened until the tokens line up. A
+    // token that ends before the window's last byte is the same as in
+    // the whole text, since the Lexer looks at most one byte further.
+    Position relex(size_t offset, size_t deleted, size_t inserted, size_t start, Position first, std::vector<Token> &out,
+                   std::vector<Diagnostic> &lexed)
+    {
+        size_t end = offset + inserted;
+        size_t kept = out.size();
+        for (size_t reach = 256;; reach *= 2)
+        {
+            size_t windowEnd = std::min(text.size(), end + reach);
+            std::string_view window = text.view(start, windowEnd);
+            bool whole = windowEnd == text.size();
+            Lexer lexer(window);
+            Position old = first;
+            out.resize(kept);
+            for (;;)
+            {
+                Token token = lexer.nextToken();
+                if (!whole && (token.type == T_EOF || token.offset + token.length >= window.size()))
+                    break;
+                token.offset += start;
+                if (token.offset >= end)
+                {
+                    // Lined up again if an old token started here; T_EOF always does
+                    size_t was = token.offset - inserted + deleted;
+                    while (absolute(old).offset < was)
+                        old = next(old);
+                    if (absolute(old).offset == was)
+                    {
+                        for (size_t i = kept; i < out.size(); i++)
+                        {
+                            if (out[i].type == T_ID)
+                                out[i].id = intern(window.substr(out[i].offset - start, out[i].length));
+                        }
+                        for (Diagnostic diagnostic : lexer.diagnostics())
+                        {
+                            diagnostic.offset += start;
+                            lexed.push_back(std::move(diagnostic));
+                        }
+                        for (Position at = first; at != old; at = next(at))
+                        {
+                            Token replaced = absolute(at);
+                            if (replaced.type == T_ID)
+                                release(replaced.id);
+                        }
+                        return old;
+                    }
+                }
+                out.push_back(token);
+            }
+        }
+    }
+
+    // Replaces parts [from, keep) with parts parsed from stream, which
+    // starts with the first token of parts[from], up to the first old part
+    // that lines up. lexed holds the lexer diagnostics of bytes [start,
+    // resync) of the old text, in new offsets; kept parts move by shift.
+    // The split is at keep on entry, and after the new parts on return.
+    void update(size_t from, size_t keep, Stream &stream, std::vector<Diagnostic> &lexed, size_t start, size_t resync,
+                size_t shift)
+    {
+        std::vector<std::unique_ptr<Part>> fresh;
+        keep = parseParts(from, keep, stream, shift, fresh);
+
+        std::vector<Diagnostic> lexerErrors;
+        for (size_t p = from; p < keep; p++)
+        {
+            for (Diagnostic diagnostic : parts[p]->lexerErrors)
+            {
+                diagnostic.offset += startOf(*parts[p]);
+                if (diagnostic.offset < start)
+                    lexerErrors.push_back(std::move(diagnostic));
+            }
+        }
+        lexerErrors.insert(lexerErrors.end(), std::make_move_iterator(lexed.begin()), std::make_move_iterator(lexed.end()));
+        for (size_t p = from; p < keep; p++)
+        {
+            for (Diagnostic diagnostic : parts[p]->lexerErrors)
+            {
+                diagnostic.offset += startOf(*parts[p]);
+                if (diagnostic.offset >= resync)
+                {
+                    diagnostic.offset += shift;
+                    lexerErrors.push_back(std::move(diagnostic));
+                }
+            }
+        }
+
+        // What the parts after the replaced ones saw of the names they bound
+        std::unordered_map<uint32_t, Outcome> was;
+        uint32_t replaced = 0;
+        for (size_t p = from; p < keep; p++)
+        {
+            for (const Write &write : parts[p]->writes)
+                was[write.id] = Outcome{baseOf(*parts[p]) + write.variable, write.implicit ? IMPLICIT : DECLARED};
+            withdraw(*parts[p]);
+            replaced += parts[p]->fresh;
+        }
+        size_t oldFrom = from < parts.size() ? startOf(*parts[from]) : 0;
+        size_t oldKeep = keep < parts.size() ? startOf(*parts[keep]) : SIZE_MAX;
+        // The kept parts move with the end of the source
+        length = text.size();
+
+        size_t end = keep < parts.size() ? startOf(*parts[keep]) : text.size();
+        auto errors = lexerErrors.begin();
+        for (size_t i = 0; i < fresh.size(); i++)
+        {
+            Part &part = *fresh[i];
+            size_t next = i + 1 < fresh.size() ? fresh[i + 1]->start : end;
+            for (; errors != lexerErrors.end() && (errors->offset < next || i + 1 == fresh.size()); ++errors)
+            {
+                part.lexerErrors.push_back(std::move(*errors));
+                part.lexerErrors.back().offset -= part.start;
+            }
+            std::string_view span = text.view(part.start, next);
+            for (const char *at = span.data(); (at = static_cast<const char *>(memchr(at, '\n', span.data() + span.size() - at)));)
+            {
+                at++;
+                part.lines.push_back(uint32_t(at - span.data()));
+            }
+        }
+
+        size_t count = fresh.size();
+        parts.erase(parts.begin() + from, parts.begin() + keep);
+        parts.insert(parts.begin() + from, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+        split = from + count;
+        size_t kept = split < parts.size() ? startOf(*parts[split]) : SIZE_MAX;
+        if (renumberFrom != SIZE_MAX && renumberFrom >= oldFrom)
+            renumberFrom = renumberFrom >= oldKeep ? renumberFrom + shift : kept;
+
+        // The new parts count from the front; the kept ones' bases move
+        // with the slot count
+        uint32_t base = from > 0 ? baseOf(*parts[from - 1]) + parts[from - 1]->fresh : 0;
+        std::unordered_map<uint32_t, Outcome> is;
+        for (size_t p = from; p < split; p++)
+        {
+            Part &part = *parts[p];
+            part.base = base;
+            settle(part);
+            base += part.fresh;
+            for (const Write &write : part.writes)
+                is[write.id] = Outcome{part.base + write.variable, write.implicit ? IMPLICIT : DECLARED};
+        }
+        slotCount = slotCount - replaced + (base - baseOf(*parts[from]));
+        if (base - baseOf(*parts[from]) != replaced)
+            renumberFrom = std::min(renumberFrom, kept);
+
+        // Parts after the new ones that find a name bound elsewhere are
+        // renumbered, and settled again if it is bound differently
+        size_t first = parts[from]->start, last = parts[split - 1]->start;
+        auto before = [&](uint32_t id) {
+            const Binding *binding = visible(id, first);
+            return Outcome{binding ? baseOf(*binding->part) + binding->variable : 0, boundBy(binding)};
+        };
+        for (const auto &entry : was)
+        {
+            auto now = is.find(entry.first);
+            if (entry.second != (now != is.end() ? now->second : before(entry.first)))
+                touch(entry.first, last);
+        }
+        for (const auto &entry : is)
+        {
+            if (!was.count(entry.first) && entry.second != before(entry.first))
+                touch(entry.first, last);
+        }
+        while (!queue.empty())
+        {
+            Part &part = *queue.top().second;
+            queue.pop();
+            part.queued = false;
+            std::vector<Write> writes = part.writes;
+            uint32_t had = part.fresh;
+            settle(part);
+            part.renumber = true;
+            if (part.fresh != had)
+            {
+                // Only the parts after this one move
+                size_t at = std::lower_bound(parts.begin() + split, parts.end(), startOf(part), [&](const std::unique_ptr<Part> &part, size_t start) {
+                    return startOf(*part) < start;
+                }) - parts.begin();
+                for (size_t p = split; p <= at; p++)
+                    parts[p]->base += part.fresh - had;
+                slotCount += part.fresh - had;
+                renumberFrom = std::min(renumberFrom, startOf(part));
+            }
+            for (const Write &write : writes)
+            {
+                if (!binds(part.writes, write))
+                    touch(write.id, startOf(part));
+            }
+            for (const Write &write : part.writes)
+            {
+                if (!binds(writes, write))
+                    touch(write.id, startOf(part));
+            }
+        }
+        reclaim();
+        diagnosed = false;
+    }
+
+    // Parses new parts from the start of parts[from], or of the source
+    // if there are none, until lined up with the start of an old part
+    // from parts[keep] on. Returns the index of the first part kept.
+    size_t parseParts(size_t from, size_t keep, Stream &stream, size_t shift, std::vector<std::unique_ptr<Part>> &fresh)
+    {
+        auto moved = [&](size_t p) {
+            return startOf(*parts[p]) + shift;
+        };
+        size_t start = from < parts.size() ? startOf(*parts[from]) : 0;
+        size_t begin = 0;
+        for (bool done = false; !done;)
+        {
+            StreamReader reader(stream, text, begin);
+            BasicParser<StreamReader> parser(reader);
+            parser.deferTopLevelNames();
+            size_t at = begin;
+            for (;;)
+            {
+                // The next old part to try to line up with starts past at
+                while (keep < parts.size() && moved(keep) <= stream[at].offset)
+                    keep++;
+                Token stop = stream[std::max(begin + PART_TOKENS, at + 1)];
+                size_t limit = stop.type == T_EOF ? SIZE_MAX : stop.offset;
+                if (keep < parts.size())
+                    limit = std::min(limit, moved(keep));
+                parser.parseStatements(limit);
+                size_t position = parser.position();
+                at = stream.indexOf(position);
+                while (keep < parts.size() && moved(keep) < position)
+                    keep++;
+                if (stream[at].type == T_EOF)
+                {
+                    keep = parts.size();
+                    done = true;
+                    break;
+                }
+                if (!parser.recovering())
+                {
+                    if (keep < parts.size() && moved(keep) == position)
+                    {
+                        done = true;
+                        break;
+                    }
+                    if (at - begin >= PART_TOKENS)
+                        break;
+                }
+            }
+            size_t end = stream[at].type == T_EOF ? at + 1 : at;
+            fresh.push_back(newPart(start, stream, begin, end, parser.takePart()));
+            begin = at;
+            start = stream[at].offset;
+        }
+        return keep;
+    }
+
+    std::unique_ptr<Part> newPart(size_t start, Stream &stream, size_t begin, size_t end, ParsedPart parsed)
+    {
+        std::unique_ptr<Part> part(new Part{start, 0, false, {}, {}, {}, std::move(parsed), nullptr, {}, start, true, {}, 0, {}, {}, {}, false});
+        for (size_t i = begin; i < end; i++)
+        {
+            part->tokens.push_back(stream[i]);
+            part->tokens.back().offset -= start;
+        }
+        for (Diagnostic &error : part->parsed.errors)
+            error.offset -= start;
+        for (DeferredSlot &slot : part->parsed.slots)
+            slot.name.offset -= start;
+        for (Node *statement = part->parsed.statements; statement; statement = statement->next)
+            part->last = statement;
+        for (Node *node : part->parsed.named)
+            part->local.push_back(node->slot);
+        return part;
+    }
+
+    // The last binding of id by a part that starts before start
+    const Binding *visible(uint32_t id, size_t start) const
+    {
+        const std::vector<Binding> &bindings = names[id].bindings;
+        auto after = std::lower_bound(bindings.begin(), bindings.end(), start, [&](const Binding &binding, size_t start) {
+            return startOf(*binding.part) < start;
+        });
+        return after == bindings.begin() ? nullptr : &*(after - 1);
+    }
+
+    static Bound boundBy(const Binding *binding)
+    {
+        return !binding ? UNBOUND : binding->implicit ? IMPLICIT : DECLARED;
+    }
+
+    static bool binds(const std::vector<Write> &writes, const Write &write)
+    {
+        for (const Write &other : writes)
+        {
+            if (other.id == write.id)
+                return other.variable == write.variable && other.implicit == write.implicit;
+        }
+        return false;
+    }
+
+    // The first of a name's bindings or uses by a part that starts at or
+    // after start
+    template <typename Entry>
+    typename std::vector<Entry>::iterator at(std::vector<Entry> &entries, size_t start) const
+    {
+        return std::lower_bound(entries.begin(), entries.end(), start, [&](const Entry &entry, size_t start) {
+            return startOf(*entry.part) < start;
+        });
+    }
+
+    // Marks the parts after the one starting at start that find the same
+    // binding of id as it leaves, up to the next part that binds id, for
+    // renumbering, and queues those that saw it bound differently
+    void touch(uint32_t id, size_t start)
+    {
+        Name &name = names[id];
+        auto next = at(name.bindings, start + 1);
+        size_t until = next != name.bindings.end() ? startOf(*next->part) : SIZE_MAX;
+        Bound now = boundBy(next != name.bindings.begin() ? &*(next - 1) : nullptr);
+        for (auto use = at(name.uses, start + 1); use != name.uses.end() && startOf(*use->part) <= until; ++use)
+        {
+            Part &part = *use->part;
+            part.renumber = true;
+            if (use->seen != now && !part.queued)
+            {
+                part.queued = true;
+                queue.push(std::make_pair(startOf(part), &part));
+            }
+        }
+    }
+
+    // Settles part's deferred slots against the bindings of the parts
+    // before it, as TopLevelNames would, and enters what it bound and
+    // looked up in names. The part's own entries are not visible to it.
+    void settle(Part &part)
+    {
+        if (++epoch == 0)
+        {
+            for (Local &local : scratch)
+                local.epoch = 0;
+            epoch = 1;
+        }
+        scratch.resize(std::max(scratch.size(), names.size()), Local{0, 0, UNBOUND, UNBOUND, false});
+        size_t start = startOf(part);
+        part.settled.resize(part.parsed.slots.size());
+        part.fresh = 0;
+        part.settleErrors.clear();
+        std::vector<uint32_t> reads;
+        std::vector<Write> writes;
+        reads.swap(part.reads);
+        writes.swap(part.writes);
+        auto lookup = [&](uint32_t id) -> Local & {
+            Local &local = scratch[id];
+            if (local.epoch != epoch)
+            {
+                Bound seen = boundBy(visible(id, start));
+                local = Local{epoch, 0, seen, seen, false};
+                part.reads.push_back(id);
+            }
+            return local;
+        };
+        auto bind = [&](Local &local, uint32_t id, uint32_t variable, Bound bound) {
+            local.variable = variable;
+            local.bound = bound;
+            if (!local.own)
+            {
+                local.own = true;
+                part.writes.push_back(Write{id, 0, false});
+            }
+        };
+        for (uint32_t slot = 0; slot < part.parsed.slots.size(); slot++)
+        {
+            const DeferredSlot &deferred = part.parsed.slots[slot];
+            uint32_t id = deferred.name.id;
+            auto report = [&](DiagnosticCode code, std::string message) {
+                if (deferred.report)
+                    part.settleErrors.push_back({code, deferred.name.offset, std::move(message), {}});
+            };
+            switch (deferred.origin)
+            {
+            case SLOT_LOCAL:
+                part.settled[slot] = part.fresh++;
+                break;
+            case SLOT_TOP_LEVEL:
+            {
+                Local &local = lookup(id);
+                if (local.bound == DECLARED)
+                {
+                    report(DIAG_REDECLARED_VARIABLE, redeclaredMessage(names[id].spelling));
+                    part.settled[slot] = local.own ? local.variable : REFERENCE | id;
+                }
+                else
+                {
+                    part.settled[slot] = part.fresh++;
+                    bind(local, id, part.settled[slot], DECLARED);
+                }
+                break;
+            }
+            case SLOT_UNRESOLVED:
+            {
+                Local &local = lookup(id);
+                if (local.bound != UNBOUND)
+                {
+                    part.settled[slot] = local.own ? local.variable : REFERENCE | id;
+                }
+                else
+                {
+                    report(DIAG_UNDECLARED_VARIABLE, undeclaredMessage(names[id].spelling));
+                    part.settled[slot] = part.fresh++;
+                    if (deferred.depth == 0)
+                        bind(local, id, part.settled[slot], IMPLICIT);
+                }
+                break;
+            }
+            }
+        }
+
+        // Entries of a part settled before are updated in place, since a
+        // name used all over the program has a long list
+        for (uint32_t id : reads)
+        {
+            if (scratch[id].epoch != epoch)
+            {
+                std::vector<Use> &uses = names[id].uses;
+                uses.erase(at(uses, start));
+            }
+        }
+        for (const Write &write : writes)
+        {
+            if (scratch[write.id].epoch != epoch || !scratch[write.id].own)
+            {
+                std::vector<Binding> &bindings = names[write.id].bindings;
+                bindings.erase(at(bindings, start));
+            }
+        }
+        for (uint32_t id : part.reads)
+        {
+            std::vector<Use> &uses = names[id].uses;
+            auto use = at(uses, start);
+            if (use != uses.end() && use->part == &part)
+                use->seen = scratch[id].seen;
+            else
+                uses.insert(use, Use{&part, scratch[id].seen});
+        }
+        for (Write &write : part.writes)
+        {
+            const Local &local = scratch[write.id];
+            write.variable = local.variable;
+            write.implicit = local.bound == IMPLICIT;
+            std::vector<Binding> &bindings = names[write.id].bindings;
+            auto binding = at(bindings, start);
+            if (binding != bindings.end() && binding->part == &part)
+                *binding = Binding{&part, write.variable, write.implicit};
+            else
+                bindings.insert(binding, Binding{&part, write.variable, write.implicit});
+        }
+    }
+
+    // Removes what part bound and looked up from names
+    void withdraw(Part &part)
+    {
+        size_t start = startOf(part);
+        for (uint32_t id : part.reads)
+        {
+            std::vector<Use> &uses = names[id].uses;
+            uses.erase(at(uses, start));
+        }
+        for (const Write &write : part.writes)
+        {
+            std::vector<Binding> &bindings = names[write.id].bindings;
+            bindings.erase(at(bindings, start));
+        }
+    }
+
+    uint32_t slotOf(const Part &part, uint32_t local) const
+    {
+        uint32_t settled = part.settled[local];
+        if (!(settled & REFERENCE))
+            return baseOf(part) + settled;
+        const Binding *binding = visible(settled & ~REFERENCE, startOf(part));
+        return baseOf(*binding->part) + binding->variable;
+    }
+
+    // Moves the offsets of the part's nodes to its current start
+    void moveNodes(Part &part)
+    {
+        size_t moved = startOf(part) - part.nodesAt;
+        // The last statement's next is the next part's first
+        for (Node *statement = part.parsed.statements; statement; statement = statement == part.last ? nullptr : statement->next)
+        {
+            statement->token.offset += moved;
+            for (Node *child : {statement->first, statement->second, statement->third})
+            {
+                if (child)
+                    pending.push_back(child);
+            }
+            while (!pending.empty())
+            {
+                Node *node = pending.back();
+                pending.pop_back();
+                node->token.offset += moved;
+                for (Node *child : {node->first, node->second, node->third, node->next})
+                {
+                    if (child)
+                        pending.push_back(child);
+                }
+            }
+        }
+        part.nodesAt = startOf(part);
+    }
+
+    // Gathers the diagnostics of every part in the order parse() reports
+    // them, and works out their lines from the parts' line starts
+    void locateDiagnostics()
+    {
+        std::vector<Diagnostic> &all = current.diagnostics;
+        all.clear();
+        for (const std::unique_ptr<Part> &part : parts)
+        {
+            for (Diagnostic diagnostic : part->lexerErrors)
+            {
+                diagnostic.offset += startOf(*part);
+                all.push_back(std::move(diagnostic));
+            }
+        }
+        for (const std::unique_ptr<Part> &part : parts)
+        {
+            for (const std::vector<Diagnostic> *errors : {&part->parsed.errors, &part->settleErrors})
+            {
+                for (Diagnostic diagnostic : *errors)
+                {
+                    diagnostic.offset += startOf(*part);
+                    all.push_back(std::move(diagnostic));
+                }
+            }
+        }
+        std::stable_sort(all.begin(), all.end(), [](const Diagnostic &a, const Diagnostic &b) {
+            return a.offset < b.offset;
+        });
+
+        size_t p = 0;
+        size_t line = 1, lineStart = 0; // At the start of parts[p]
+        for (Diagnostic &diagnostic : all)
+        {
+            while (p + 1 < parts.size() && startOf(*parts[p + 1]) <= diagnostic.offset)
+            {
+                const Part &part = *parts[p++];
+                line += part.lines.size();
+                if (!part.lines.empty())
+                    lineStart = startOf(part) + part.lines.back();
+            }
+            const Part &part = *parts[p];
+            size_t start = startOf(part);
+            size_t within = std::upper_bound(part.lines.begin(), part.lines.end(), diagnostic.offset - start) - part.lines.begin();
+            size_t from = within > 0 ? start + part.lines[within - 1] : lineStart;
+            diagnostic.location = SourceLocation{int(line + within), int(diagnostic.offset - from + 1)};
+        }
+        diagnosed = true;
+    }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <string>
+#include "parser.h"
+#include "interpreter.h"
+#include "bytecode.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "source_file.h"
+
+using namespace std;
+
+// Runs a program and prints the value it returns. The tree is optimized
+// and compiled to bytecode for the VM; --tree uses the tree-walking
+// interpreter instead, --jit the tree-walking interpreter with hot loops
+// compiled to machine code, and --no-optimize skips the optimizer.
+//
+// Usage: interpreter [--tree | --jit] [--no-optimize] <abc.txt | ->
+
+int main(int argc, char *argv[])
+{
+    bool tree = false;
+    bool jit = false;
+    bool optimizeTree = true;
+    const char *filename = nullptr;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--tree")
+            tree = true;
+        else if (argument == "--jit")
+            jit = true;
+        else if (argument == "--no-optimize")
+            optimizeTree = false;
+        else if (!filename)
+            filename = argv[i];
+        else
+            usage = true;
+    }
+    if (!filename || usage || (tree && jit))
+    {
+        cerr << "Usage: " << argv[0] << " [--tree | --jit] [--no-optimize] <abc.txt | ->" << endl;
+        return 1;
+    }
+    SourceFile source(filename);
+    if (!source.isOpen())
+    {
+        cerr << "Error: " << source.errorMessage() << endl;
+        return 1;
+    }
+
+    ParseResult program = parse(source.text());
+    for (const Diagnostic &diagnostic : program.diagnostics)
+    {
+        cout << diagnostic.message << " at line " << diagnostic.location.line << ", column " << diagnostic.location.column << endl;
+    }
+    if (!program.ok())
+    {
+        return 1;
+    }
+
+    if (optimizeTree)
+    {
+        optimize(program);
+    }
+
+    RunResult result;
+    if (tree)
+    {
+        result = Interpreter(program).run();
+    }
+    else if (jit)
+    {
+        LoopJit loopJit(program);
+        result = Interpreter(program, &loopJit).run();
+    }
+    else
+    {
+        Bytecode bytecode = Compiler(program).compile();
+        result = VirtualMachine(bytecode).run();
+    }
+    if (result.status != RUN_OK)
+    {
+        static const char *reasons[] = {"", "", "Division by zero", "Nesting too deep"};
+        SourceLocation at = LineIndex(program.source).locate(result.offset);
+        cout << "Runtime error: " << reasons[result.status] << " at line " << at.line << ", column " << at.column << endl;
+        return 1;
+    }
+    cout << "Program returned " << result.value << endl;
+    return 0;
+}
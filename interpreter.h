@@ -0,0 +1,271 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "parser.h"
+
+// Tree-walking evaluator for the trees built by parser.h. Variables live in
+// a flat vector indexed by Node::slot, which the parser resolved to the
+// declaration in scope, so reading or writing one is an array access, not
+// a lookup.
+//
+// Values are 64-bit integers. + - * wrap around on overflow, comparisons
+// and && || give 0 or 1, and && || evaluate their right operand only when
+// it decides the result. Variables hold 0 until assigned, and running a
+// declaration sets its variable back to 0. A return statement ends the
+// program with its value; running off the end returns 0.
+
+enum RunStatus
+{
+    RUN_OK,
+    RUN_SYNTAX_ERROR,     // The ParseResult has diagnostics, so nothing was run
+    RUN_DIVISION_BY_ZERO,
+    RUN_TOO_DEEP,         // Statements or expressions nested beyond Interpreter::MAX_DEPTH
+};
+
+struct RunResult
+{
+    RunStatus status;
+    int64_t value; // Returned value when status is RUN_OK
+    size_t offset; // Source offset of the failure otherwise
+};
+
+enum LoopOutcome
+{
+    LOOP_DECLINED,          // Left to the Interpreter
+    LOOP_FINISHED,          // Ran until its condition was false
+    LOOP_RETURNED,          // A return statement in the loop ended the program
+    LOOP_DIVISION_BY_ZERO,
+};
+
+// A faster way to run hot while loops, such as the JIT in jit.h. The
+// Interpreter offers each while loop of its program to it on entry and
+// again after every OFFER_INTERVAL runs of the body. It either declines,
+// or runs the loop from its next condition test to the end on the
+// variables, indexed by Node::slot, and stores the returned value or the
+// failing offset in out.
+class LoopTier
+{
+public:
+    static constexpr uint32_t OFFER_INTERVAL = 16;
+
+    virtual ~LoopTier() {}
+
+    // depth is the Interpreter's nesting depth at the loop; a tier must
+    // decline a loop the Interpreter would fail on as too deep
+    virtual LoopOutcome offer(const ParseResult &program, const Node *loop, int depth, int64_t *variables, int64_t &out) = 0;
+};
+
+class Interpreter
+{
+public:
+    // The evaluator recurses over the tree, so nesting is capped to keep
+    // generated input from exhausting the native stack
+    static constexpr int MAX_DEPTH = 10000;
+
+    Interpreter(const ParseResult &program, LoopTier *tier = nullptr)
+        : program(program), tier(tier), variables(program.slotCount, 0), status(RUN_OK), failedAt(0), depth(0) {}
+
+    RunResult run()
+    {
+        if (!program.ok())
+        {
+            return RunResult{RUN_SYNTAX_ERROR, 0, program.diagnostics.front().offset};
+        }
+        std::fill(variables.begin(), variables.end(), 0);
+        status = RUN_OK;
+        depth = 0;
+        int64_t value = 0;
+        executeList(program.root->first, value);
+        if (status != RUN_OK)
+        {
+            return RunResult{status, 0, failedAt};
+        }
+        return RunResult{RUN_OK, value, 0};
+    }
+
+    // Variable values after run(), indexed by Node::slot
+    const std::vector<int64_t> &slots() const
+    {
+        return variables;
+    }
+
+private:
+    const ParseResult &program;
+    LoopTier *tier;
+    std::vector<int64_t> variables;
+    RunStatus status;
+    size_t failedAt;
+    int depth;
+
+    void fail(RunStatus failure, const Node *node)
+    {
+        if (status == RUN_OK)
+        {
+            status = failure;
+            failedAt = node->token.offset;
+        }
+    }
+
+    // The statement functions return true when the program has finished,
+    // either through a return statement, whose value is stored in result,
+    // or through an error
+    bool executeList(const Node *statement, int64_t &result)
+    {
+        for (; statement; statement = statement->next)
+        {
+            if (execute(statement, result))
+                return true;
+        }
+        return false;
+    }
+
+    bool execute(const Node *node, int64_t &result)
+    {
+        if (depth == MAX_DEPTH)
+        {
+            fail(RUN_TOO_DEEP, node);
+            return true;
+        }
+        depth++;
+        bool finished = executeNode(node, result);
+        depth--;
+        return finished;
+    }
+
+    bool executeNode(const Node *node, int64_t &result)
+    {
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            return executeList(node->first, result);
+        case N_DECLARATION:
+            variables[node->slot] = 0;
+            return false;
+        case N_ASSIGNMENT:
+        {
+            int64_t value = evaluate(node->first);
+            variables[node->slot] = value;
+            return status != RUN_OK;
+        }
+        case N_IF:
+        {
+            int64_t condition = evaluate(node->first);
+            if (status != RUN_OK)
+                return true;
+            if (condition)
+                return execute(node->second, result);
+            return node->third && execute(node->third, result);
+        }
+        case N_WHILE:
+            for (uint32_t runs = 0;; runs++)
+            {
+                if (tier && runs % LoopTier::OFFER_INTERVAL == 0)
+                {
+                    int64_t out = 0;
+                    switch (tier->offer(program, node, depth, variables.data(), out))
+                    {
+                    case LOOP_FINISHED:
+                        return false;
+                    case LOOP_RETURNED:
+                        result = out;
+                        return true;
+                    case LOOP_DIVISION_BY_ZERO:
+                        status = RUN_DIVISION_BY_ZERO;
+                        failedAt = size_t(out);
+                        return true;
+                    default:
+                        break;
+                    }
+                }
+                int64_t condition = evaluate(node->first);
+                if (status != RUN_OK)
+                    return true;
+                if (!condition)
+                    return false;
+                if (execute(node->second, result))
+                    return true;
+            }
+        case N_RETURN:
+            result = evaluate(node->first);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    int64_t evaluate(const Node *node)
+    {
+        if (depth == MAX_DEPTH)
+        {
+            fail(RUN_TOO_DEEP, node);
+            return 0;
+        }
+        depth++;
+        int64_t value = evaluateNode(node);
+        depth--;
+        return value;
+    }
+
+    int64_t evaluateNode(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case N_NUMBER:
+            return node->value;
+        case N_IDENTIFIER:
+            return variables[node->slot];
+        case N_BINARY:
+            break;
+        default:
+            return 0;
+        }
+
+        TokenType op = node->token.type;
+        int64_t left = evaluate(node->first);
+        if (op == T_LOGICAL_AND)
+            return left && evaluate(node->second);
+        if (op == T_LOGICAL_OR)
+            return left || evaluate(node->second);
+        int64_t right = evaluate(node->second);
+        switch (op)
+        {
+        case T_PLUS:
+            return int64_t(uint64_t(left) + uint64_t(right));
+        case T_MINUS:
+            return int64_t(uint64_t(left) - uint64_t(right));
+        case T_MUL:
+            return int64_t(uint64_t(left) * uint64_t(right));
+        case T_DIV:
+            if (right == 0)
+            {
+                fail(RUN_DIVISION_BY_ZERO, node);
+                return 0;
+            }
+            if (right == -1)
+                return int64_t(0 - uint64_t(left)); // INT64_MIN / -1 wraps instead of trapping
+            return left / right;
+        case T_GT:
+            return left > right;
+        case T_LT:
+            return left < right;
+        case T_GE:
+            return left >= right;
+        case T_LE:
+            return left <= right;
+        case T_EQ:
+        case T_EQUAL:
+            return left == right;
+        case T_NEQ:
+        case T_NOT_EQUAL:
+            return left != right;
+        default:
+            return 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,788 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "parser.h"
+#include "interpreter.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_SUPPORTED 1
+#endif
+
+// In-process JIT tier for the Interpreter. Once a while loop is hot, its
+// whole statement (condition, body and any loops nested in it) is compiled
+// to x86-64 machine code in an mmap'd page, and the Interpreter jumps to
+// that code instead of walking the loop. Since all program state lives in
+// the variables vector, the switch can happen at any condition test.
+//
+// The compiled loop is a System V function
+//
+//     LoopOutcome loop(int64_t *variables, int64_t *out);
+//
+// that loads the variables it uses most into registers, weighting uses in
+// nested loops higher, runs to the end of the loop and stores them back.
+// The code follows the same scheme as codegen_x86.h, encoded directly
+// rather than through an assembler. Elsewhere than Linux on x86-64 every
+// loop is declined, so the Interpreter runs as before.
+//
+//     LoopJit jit(program);
+//     RunResult result = Interpreter(program, &jit).run();
+
+// Encoder for the handful of x86-64 instructions the loop compiler needs.
+// Memory operands are always [rdi + disp32], which is where the variables
+// array is passed.
+class X86Assembler
+{
+public:
+    enum Register : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+    };
+
+    // The low bit of each condition code selects its negation
+    enum Condition : uint8_t
+    {
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_L = 0xC,
+        CC_GE = 0xD,
+        CC_LE = 0xE,
+        CC_G = 0xF,
+    };
+
+    struct Operand
+    {
+        enum Kind : uint8_t
+        {
+            REGISTER,
+            MEMORY,    // [rdi + value]
+            IMMEDIATE, // Sign-extended 32-bit value
+        };
+        Kind kind;
+        Register reg;
+        int32_t value;
+    };
+
+    static Operand registerOperand(Register reg)
+    {
+        return Operand{Operand::REGISTER, reg, 0};
+    }
+
+    static Operand memoryOperand(int32_t displacement)
+    {
+        return Operand{Operand::MEMORY, RAX, displacement};
+    }
+
+    static Operand immediateOperand(int32_t value)
+    {
+        return Operand{Operand::IMMEDIATE, RAX, value};
+    }
+
+    static Condition invert(Condition condition)
+    {
+        return Condition(condition ^ 1);
+    }
+
+    std::vector<uint8_t> code;
+
+    uint32_t newLabel()
+    {
+        labels.push_back(UNPLACED);
+        return uint32_t(labels.size() - 1);
+    }
+
+    void place(uint32_t label)
+    {
+        labels[label] = code.size();
+    }
+
+    // Resolves jumps once every label has been placed
+    void finish()
+    {
+        for (const auto &fixup : fixups)
+        {
+            int32_t relative = int32_t(labels[fixup.second] - (fixup.first + 4));
+            std::memcpy(&code[fixup.first], &relative, 4);
+        }
+        fixups.clear();
+    }
+
+    void load(Register destination, const Operand &source)
+    {
+        if (source.kind == Operand::IMMEDIATE)
+            loadImmediate(destination, source.value);
+        else if (source.kind != Operand::REGISTER || source.reg != destination)
+            instruction({0x8B}, destination, source);
+    }
+
+    void store(const Operand &destination, Register source)
+    {
+        instruction({0x89}, source, destination);
+    }
+
+    // mov [base], source, for a base other than rsp, rbp, r12 and r13
+    void storeIndirect(Register base, Register source)
+    {
+        code.push_back(uint8_t(0x48 | (source & 8 ? 4 : 0) | (base & 8 ? 1 : 0)));
+        code.push_back(0x89);
+        code.push_back(uint8_t((source & 7) << 3 | (base & 7)));
+    }
+
+    void loadImmediate(Register destination, int64_t value)
+    {
+        if (value == 0)
+        {
+            zero(destination);
+        }
+        else if (value >= INT32_MIN && value <= INT32_MAX)
+        {
+            instruction({0xC7}, RAX, registerOperand(destination));
+            immediate32(int32_t(value));
+        }
+        else
+        {
+            code.push_back(uint8_t(0x48 | (destination & 8 ? 1 : 0)));
+            code.push_back(uint8_t(0xB8 | (destination & 7)));
+            for (int i = 0; i < 8; i++)
+                code.push_back(uint8_t(uint64_t(value) >> (8 * i)));
+        }
+    }
+
+    void zero(Register reg)
+    {
+        instruction({0x31}, reg, registerOperand(reg), false);
+    }
+
+    void add(Register destination, const Operand &source)
+    {
+        arithmetic(0x03, 0, destination, source);
+    }
+
+    void subtract(Register destination, const Operand &source)
+    {
+        arithmetic(0x2B, 5, destination, source);
+    }
+
+    void compare(Register left, const Operand &right)
+    {
+        arithmetic(0x3B, 7, left, right);
+    }
+
+    void multiply(Register destination, const Operand &source)
+    {
+        if (source.kind == Operand::IMMEDIATE)
+        {
+            instruction({0x69}, destination, registerOperand(destination));
+            immediate32(source.value);
+        }
+        else
+        {
+            instruction({0x0F, 0xAF}, destination, source);
+        }
+    }
+
+    void test(Register left, Register right)
+    {
+        instruction({0x85}, right, registerOperand(left));
+    }
+
+    // eax = condition ? 1 : 0
+    void set(Condition condition)
+    {
+        code.insert(code.end(), {0x0F, uint8_t(0x90 | condition), 0xC0}); // setcc al
+        code.insert(code.end(), {0x0F, 0xB6, 0xC0});                      // movzx eax, al
+    }
+
+    void jump(uint32_t label)
+    {
+        code.push_back(0xE9);
+        relative32(label);
+    }
+
+    void jumpIf(Condition condition, uint32_t label)
+    {
+        code.push_back(0x0F);
+        code.push_back(uint8_t(0x80 | condition));
+        relative32(label);
+    }
+
+    void signExtend() // cqo
+    {
+        code.insert(code.end(), {0x48, 0x99});
+    }
+
+    void divide(Register divisor) // idiv
+    {
+        instruction({0xF7}, Register(7), registerOperand(divisor));
+    }
+
+    void negate(Register reg)
+    {
+        instruction({0xF7}, Register(3), registerOperand(reg));
+    }
+
+    void push(Register reg)
+    {
+        if (reg & 8)
+            code.push_back(0x41);
+        code.push_back(uint8_t(0x50 | (reg & 7)));
+    }
+
+    void pop(Register reg)
+    {
+        if (reg & 8)
+            code.push_back(0x41);
+        code.push_back(uint8_t(0x58 | (reg & 7)));
+    }
+
+    // lea rsp, [rbp - below], dropping anything pushed since the prologue
+    void resetStack(uint8_t below)
+    {
+        code.insert(code.end(), {0x48, 0x8D, 0x65, uint8_t(-below)});
+    }
+
+    void setFramePointer() // mov rbp, rsp
+    {
+        code.insert(code.end(), {0x48, 0x89, 0xE5});
+    }
+
+    void ret()
+    {
+        code.push_back(0xC3);
+    }
+
+private:
+    static constexpr size_t UNPLACED = SIZE_MAX;
+
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, uint32_t>> fixups; // Offset of a rel32 field, target label
+
+    // One instruction with a ModRM byte: reg is the register field (or an
+    // opcode extension), rm the register or memory operand
+    void instruction(std::initializer_list<uint8_t> opcode, Register reg, const Operand &rm, bool wide = true)
+    {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0);
+        if (rm.kind == Operand::REGISTER && (rm.reg & 8))
+            rex |= 1;
+        if (rex != 0x40)
+            code.push_back(rex);
+        code.insert(code.end(), opcode);
+        if (rm.kind == Operand::REGISTER)
+        {
+            code.push_back(uint8_t(0xC0 | (reg & 7) << 3 | (rm.reg & 7)));
+        }
+        else
+        {
+            code.push_back(uint8_t(0x80 | (reg & 7) << 3 | RDI));
+            immediate32(rm.value);
+        }
+    }
+
+    // add, sub and cmp: opcode takes a register or memory source,
+    // extension selects the operation in the immediate form
+    void arithmetic(uint8_t opcode, uint8_t extension, Register destination, const Operand &source)
+    {
+        if (source.kind == Operand::IMMEDIATE)
+        {
+            instruction({0x81}, Register(extension), registerOperand(destination));
+            immediate32(source.value);
+        }
+        else
+        {
+            instruction({opcode}, destination, source);
+        }
+    }
+
+    void immediate32(int32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            code.push_back(uint8_t(uint32_t(value) >> (8 * i)));
+    }
+
+    void relative32(uint32_t label)
+    {
+        fixups.push_back({code.size(), label});
+        code.insert(code.end(), {0, 0, 0, 0});
+    }
+};
+
+// Compiles one while statement to machine code (see the top of this file)
+class LoopCompiler
+{
+public:
+    using Register = X86Assembler::Register;
+    using Operand = X86Assembler::Operand;
+
+    // depth is the Interpreter's depth at the loop, so compilation fails
+    // exactly where interpretation would run too deep
+    LoopCompiler(const Node *loop, int depth) : loop(loop), depth(depth), failed(false) {}
+
+    // Machine code, or empty when the loop nests too deeply
+    std::vector<uint8_t> compile()
+    {
+        assignRegisters();
+        uint32_t exit = code.newLabel();
+        uint32_t divisionByZero = code.newLabel();
+
+        code.push(X86Assembler::RBP);
+        code.setFramePointer();
+        for (Register reg : saved)
+            code.push(reg);
+        for (const auto &variable : inRegisters)
+            code.load(variable.second, X86Assembler::memoryOperand(int32_t(8 * variable.first)));
+
+        uint32_t body = code.newLabel();
+        uint32_t condition = code.newLabel();
+        code.jump(condition);
+        code.place(body);
+        statementCode(loop->second, exit);
+        code.place(condition);
+        branchCode(loop->first, true, body);
+        if (failed)
+            return std::vector<uint8_t>();
+        code.loadImmediate(X86Assembler::RAX, LOOP_FINISHED);
+        code.jump(exit);
+
+        for (const auto &check : divisionChecks)
+        {
+            code.place(check.first);
+            code.loadImmediate(X86Assembler::RAX, int64_t(check.second));
+            code.jump(divisionByZero);
+        }
+        code.place(divisionByZero);
+        code.storeIndirect(X86Assembler::RSI, X86Assembler::RAX);
+        code.loadImmediate(X86Assembler::RAX, LOOP_DIVISION_BY_ZERO);
+
+        code.place(exit);
+        for (const auto &variable : inRegisters)
+            code.store(X86Assembler::memoryOperand(int32_t(8 * variable.first)), variable.second);
+        code.resetStack(uint8_t(8 * saved.size()));
+        for (size_t i = saved.size(); i-- > 0;)
+            code.pop(saved[i]);
+        code.pop(X86Assembler::RBP);
+        code.ret();
+        code.finish();
+        return std::move(code.code);
+    }
+
+private:
+    // rax, rcx and rdx are scratch, rdi holds the variables and rsi out
+    static constexpr Register variableRegisters[] = {
+        X86Assembler::RBX, X86Assembler::R12, X86Assembler::R13, X86Assembler::R14, X86Assembler::R15,
+        X86Assembler::R8, X86Assembler::R9, X86Assembler::R10, X86Assembler::R11};
+    static constexpr size_t CALLEE_SAVED = 5; // The first five above
+
+    const Node *loop;
+    int depth;
+    bool failed;
+    X86Assembler code;
+    std::unordered_map<uint32_t, Register> registerOf;
+    std::vector<std::pair<uint32_t, Register>> inRegisters;
+    std::vector<Register> saved;
+    std::vector<std::pair<uint32_t, size_t>> divisionChecks; // Label, source offset
+
+    // Gives registers to the variables used most, counting a use inside k
+    // nested loops 8^k times (up to k = 4)
+    void assignRegisters()
+    {
+        std::unordered_map<uint32_t, uint64_t> weights;
+        std::vector<std::pair<const Node *, int>> pending{{loop, 0}};
+        while (!pending.empty())
+        {
+            const Node *node = pending.back().first;
+            int outer = pending.back().second;
+            pending.pop_back();
+            if (node != loop && node->next)
+                pending.push_back({node->next, outer});
+            int loops = node->kind == N_WHILE ? std::min(outer + 1, 4) : outer;
+            if (node->kind == N_IDENTIFIER || node->kind == N_ASSIGNMENT || node->kind == N_DECLARATION)
+                weights[node->slot] += uint64_t(1) << (3 * loops);
+            for (const Node *child : {node->first, node->second, node->third})
+            {
+                if (child)
+                    pending.push_back({child, loops});
+            }
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t>> ranked;
+        for (const auto &weight : weights)
+            ranked.push_back({weight.second, weight.first});
+        std::sort(ranked.begin(), ranked.end(), [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+        size_t count = std::min(ranked.size(), std::size(variableRegisters));
+        for (size_t i = 0; i < count; i++)
+        {
+            registerOf[ranked[i].second] = variableRegisters[i];
+            inRegisters.push_back({ranked[i].second, variableRegisters[i]});
+            if (i < CALLEE_SAVED)
+                saved.push_back(variableRegisters[i]);
+        }
+    }
+
+    Operand location(uint32_t slot) const
+    {
+        auto found = registerOf.find(slot);
+        if (found != registerOf.end())
+            return X86Assembler::registerOperand(found->second);
+        return X86Assembler::memoryOperand(int32_t(8 * slot));
+    }
+
+    bool enter()
+    {
+        if (depth == Interpreter::MAX_DEPTH)
+        {
+            failed = true;
+            return false;
+        }
+        depth++;
+        return true;
+    }
+
+    void statementCode(const Node *node, uint32_t exit)
+    {
+        if (!enter())
+            return;
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            for (const Node *statement = node->first; statement; statement = statement->next)
+                statementCode(statement, exit);
+            break;
+        case N_DECLARATION:
+        {
+            Operand variable = location(node->slot);
+            if (variable.kind == Operand::REGISTER)
+            {
+                code.zero(variable.reg);
+            }
+            else
+            {
+                code.zero(X86Assembler::RAX);
+                code.store(variable, X86Assembler::RAX);
+            }
+            break;
+        }
+        case N_ASSIGNMENT:
+            expressionCode(node->first);
+            code.store(location(node->slot), X86Assembler::RAX);
+            break;
+        case N_IF:
+        {
+            uint32_t elseLabel = code.newLabel();
+            branchCode(node->first, false, elseLabel);
+            statementCode(node->second, exit);
+            if (node->third)
+            {
+                uint32_t end = code.newLabel();
+                code.jump(end);
+                code.place(elseLabel);
+                statementCode(node->third, exit);
+                code.place(end);
+            }
+            else
+            {
+                code.place(elseLabel);
+            }
+            break;
+        }
+        case N_WHILE:
+        {
+            uint32_t body = code.newLabel();
+            uint32_t condition = code.newLabel();
+            code.jump(condition);
+            code.place(body);
+            statementCode(node->second, exit);
+            code.place(condition);
+            branchCode(node->first, true, body);
+            break;
+        }
+        case N_RETURN:
+            expressionCode(node->first);
+            code.storeIndirect(X86Assembler::RSI, X86Assembler::RAX);
+            code.loadImmediate(X86Assembler::RAX, LOOP_RETURNED);
+            code.jump(exit);
+            break;
+        default:
+            break;
+        }
+        depth--;
+    }
+
+    static bool conditionCode(TokenType op, X86Assembler::Condition &condition)
+    {
+        switch (op)
+        {
+        case T_LT:
+            condition = X86Assembler::CC_L;
+            return true;
+        case T_LE:
+            condition = X86Assembler::CC_LE;
+            return true;
+        case T_GT:
+            condition = X86Assembler::CC_G;
+            return true;
+        case T_GE:
+            condition = X86Assembler::CC_GE;
+            return true;
+        case T_EQ:
+        case T_EQUAL:
+            condition = X86Assembler::CC_E;
+            return true;
+        case T_NEQ:
+        case T_NOT_EQUAL:
+            condition = X86Assembler::CC_NE;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Leaves the left operand in rax and returns the right one, which is
+    // rcx unless it is a variable or small constant. Left runs first, so
+    // the first of two failing divisions is the one reported.
+    Operand operandsCode(const Node *node)
+    {
+        const Node *right = node->second;
+        if (right->kind == N_IDENTIFIER)
+        {
+            expressionCode(node->first);
+            return location(right->slot);
+        }
+        if (right->kind == N_NUMBER && right->value >= INT32_MIN && right->value <= INT32_MAX)
+        {
+            expressionCode(node->first);
+            return X86Assembler::immediateOperand(int32_t(right->value));
+        }
+        expressionCode(node->first);
+        code.push(X86Assembler::RAX);
+        expressionCode(right);
+        code.load(X86Assembler::RCX, X86Assembler::registerOperand(X86Assembler::RAX));
+        code.pop(X86Assembler::RAX);
+        return X86Assembler::registerOperand(X86Assembler::RCX);
+    }
+
+    // Jumps to target when the truth of node equals when
+    void branchCode(const Node *node, bool when, uint32_t target)
+    {
+        if (!enter())
+            return;
+        TokenType op = node->kind == N_BINARY ? node->token.type : T_EOF;
+        X86Assembler::Condition condition;
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            bool both = op == T_LOGICAL_AND;
+            if (when == both)
+            {
+                uint32_t skip = code.newLabel();
+                branchCode(node->first, !both, skip);
+                branchCode(node->second, both, target);
+                code.place(skip);
+            }
+            else
+            {
+                branchCode(node->first, !both, target);
+                branchCode(node->second, !both, target);
+            }
+        }
+        else if (conditionCode(op, condition))
+        {
+            Operand right = operandsCode(node);
+            code.compare(X86Assembler::RAX, right);
+            code.jumpIf(when ? condition : X86Assembler::invert(condition), target);
+        }
+        else
+        {
+            expressionCode(node);
+            code.test(X86Assembler::RAX, X86Assembler::RAX);
+            code.jumpIf(when ? X86Assembler::CC_NE : X86Assembler::CC_E, target);
+        }
+        depth--;
+    }
+
+    // Computes node into rax
+    void expressionCode(const Node *node)
+    {
+        if (!enter())
+            return;
+        if (node->kind == N_NUMBER)
+            code.loadImmediate(X86Assembler::RAX, node->value);
+        else if (node->kind == N_IDENTIFIER)
+            code.load(X86Assembler::RAX, location(node->slot));
+        else if (node->kind == N_BINARY)
+            binaryCode(node);
+        depth--;
+    }
+
+    void binaryCode(const Node *node)
+    {
+        TokenType op = node->token.type;
+        X86Assembler::Condition condition;
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            uint32_t isFalse = code.newLabel();
+            uint32_t end = code.newLabel();
+            branchCode(node, false, isFalse);
+            code.loadImmediate(X86Assembler::RAX, 1);
+            code.jump(end);
+            code.place(isFalse);
+            code.zero(X86Assembler::RAX);
+            code.place(end);
+            return;
+        }
+
+        Operand right = operandsCode(node);
+        if (conditionCode(op, condition))
+        {
+            code.compare(X86Assembler::RAX, right);
+            code.set(condition);
+            return;
+        }
+        switch (op)
+        {
+        case T_PLUS:
+            code.add(X86Assembler::RAX, right);
+            break;
+        case T_MINUS:
+            code.subtract(X86Assembler::RAX, right);
+            break;
+        case T_MUL:
+            code.multiply(X86Assembler::RAX, right);
+            break;
+        case T_DIV:
+        {
+            code.load(X86Assembler::RCX, right);
+            uint32_t zero = code.newLabel();
+            uint32_t negate = code.newLabel();
+            uint32_t end = code.newLabel();
+            divisionChecks.push_back({zero, node->token.offset});
+            code.test(X86Assembler::RCX, X86Assembler::RCX);
+            code.jumpIf(X86Assembler::CC_E, zero);
+            // INT64_MIN / -1 traps in idiv, and x / -1 is just -x
+            code.compare(X86Assembler::RCX, X86Assembler::immediateOperand(-1));
+            code.jumpIf(X86Assembler::CC_E, negate);
+            code.signExtend();
+            code.divide(X86Assembler::RCX);
+            code.jump(end);
+            code.place(negate);
+            code.negate(X86Assembler::RAX);
+            code.place(end);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+};
+
+// The LoopTier that compiles loops once they have been offered hotOffers
+// times. Declined loops, and loops too deep to compile, stay interpreted.
+//
+// Compiled code is found again by the loop's Node, so a LoopJit serves the
+// one program it was made for, which must outlive it; loops of any other
+// program are declined. A new tree may reuse the addresses of an old one,
+// so an Interpreter for another program needs a LoopJit of its own.
+class LoopJit : public LoopTier
+{
+public:
+    LoopJit(const ParseResult &program, uint32_t hotOffers = 4) : program(program), hotOffers(hotOffers) {}
+
+    LoopJit(const LoopJit &) = delete;
+    LoopJit &operator=(const LoopJit &) = delete;
+
+    ~LoopJit()
+    {
+#ifdef JIT_SUPPORTED
+        for (const auto &page : pages)
+            munmap(page.first, page.second);
+#endif
+    }
+
+    LoopOutcome offer(const ParseResult &running, const Node *loop, int depth, int64_t *variables, int64_t &out) override
+    {
+#ifdef JIT_SUPPORTED
+        if (&running != &program)
+            return LOOP_DECLINED;
+        Loop &entry = loops[loop];
+        if (!entry.code)
+        {
+            if (entry.failed || ++entry.offers < hotOffers)
+                return LOOP_DECLINED;
+            entry.code = install(LoopCompiler(loop, depth).compile());
+            if (!entry.code)
+            {
+                entry.failed = true;
+                return LOOP_DECLINED;
+            }
+        }
+        return LoopOutcome(entry.code(variables, &out));
+#else
+        (void)running;
+        (void)loop;
+        (void)depth;
+        (void)variables;
+        (void)out;
+        return LOOP_DECLINED;
+#endif
+    }
+
+    // Loops compiled so far
+    size_t compiled() const
+    {
+        return pages.size();
+    }
+
+private:
+    using Function = int (*)(int64_t *variables, int64_t *out);
+
+    struct Loop
+    {
+        uint32_t offers = 0;
+        bool failed = false;
+        Function code = nullptr;
+    };
+
+    const ParseResult &program;
+    uint32_t hotOffers;
+    std::unordered_map<const Node *, Loop> loops;
+    std::vector<std::pair<void *, size_t>> pages;
+
+    // Copies code into fresh pages, which are made executable only once
+    // they are no longer writable
+    Function install(const std::vector<uint8_t> &code)
+    {
+#ifdef JIT_SUPPORTED
+        if (code.empty())
+            return nullptr;
+        size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+        size_t size = (code.size() + pageSize - 1) / pageSize * pageSize;
+        void *page = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED)
+            return nullptr;
+        std::memcpy(page, code.data(), code.size());
+        if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(page, size);
+            return nullptr;
+        }
+        pages.push_back({page, size});
+        return reinterpret_cast<Function>(page);
+#else
+        (void)code;
+        return nullptr;
+#endif
+    }
+};
+
+#endif
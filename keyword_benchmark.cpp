@@ -0,0 +1,137 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include "keywords.h"
+
+// Microbenchmark for keyword recognition on identifier-heavy input.
+// Compares the old if/else string-compare chain against the KeywordTable
+// perfect hash, using the keyword set of updated_parser_6.cpp.
+//
+// Usage: keyword_benchmark [words] [keyword percent]
+
+using namespace std;
+
+enum TokenType
+{
+    T_INT,
+    T_ID,
+    T_IF,
+    T_ELSE,
+    T_RETURN,
+    T_FOR,
+    T_WHILE,
+};
+
+constexpr Keyword<TokenType> keywordList[] = {
+    {"int", T_INT},
+    {"while", T_WHILE},
+    {"for", T_FOR},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+};
+constexpr auto keywords = makeKeywordTable(keywordList);
+static_assert(keywords.valid(), "no perfect hash for the keyword list");
+
+// The chain every lexer used before keywords.h
+TokenType classifyChain(string_view word)
+{
+    if (word == "int")
+        return T_INT;
+    else if (word == "while")
+        return T_WHILE;
+    else if (word == "for")
+        return T_FOR;
+    else if (word == "if")
+        return T_IF;
+    else if (word == "else")
+        return T_ELSE;
+    else if (word == "return")
+        return T_RETURN;
+    else
+        return T_ID;
+}
+
+TokenType classifyTable(string_view word)
+{
+    return keywords.lookup(word, T_ID);
+}
+
+// Identifiers of 1-12 alphanumeric characters, with keywordPercent% keywords
+// and some near misses ("in", "iff", "returns") mixed in
+vector<string> makeWords(size_t count, int keywordPercent)
+{
+    static const char *nearMisses[] = {"in", "iff", "els", "returns", "fo", "whilst", "integer"};
+    const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    mt19937 rng(42);
+    vector<string> words;
+    words.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        int roll = rng() % 100;
+        if (roll < keywordPercent)
+        {
+            words.push_back(string(keywordList[rng() % size(keywordList)].word));
+        }
+        else if (roll < keywordPercent + 5)
+        {
+            words.push_back(nearMisses[rng() % size(nearMisses)]);
+        }
+        else
+        {
+            string word(1, alphabet[rng() % 52]);
+            size_t length = 1 + rng() % 12;
+            while (word.size() < length)
+                word += alphabet[rng() % 62];
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+template <typename Classify>
+double nanosecondsPerWord(const vector<string_view> &words, Classify classify, int rounds, size_t &keywordCount)
+{
+    keywordCount = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (string_view word : words)
+            keywordCount += classify(word) != T_ID;
+    }
+    auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    return elapsed / (double(words.size()) * rounds);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int keywordPercent = argc > 2 ? atoi(argv[2]) : 10;
+    const int rounds = 20;
+
+    vector<string> storage = makeWords(count, keywordPercent);
+    vector<string_view> words(storage.begin(), storage.end());
+
+    for (string_view word : words)
+    {
+        if (classifyChain(word) != classifyTable(word))
+        {
+            cout << "Mismatch on word " << word << endl;
+            return 1;
+        }
+    }
+
+    size_t chainKeywords, tableKeywords;
+    double chain = nanosecondsPerWord(words, classifyChain, rounds, chainKeywords);
+    double table = nanosecondsPerWord(words, classifyTable, rounds, tableKeywords);
+
+    cout << "words: " << count << ", keywords: " << keywordPercent << "%" << endl;
+    cout << "if/else chain: " << chain << " ns/word (" << chainKeywords / rounds << " keywords)" << endl;
+    cout << "perfect hash:  " << table << " ns/word (" << tableKeywords / rounds << " keywords)" << endl;
+    cout << "speedup: " << chain / table << "x" << endl;
+    return 0;
+}
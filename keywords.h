@@ -0,0 +1,107 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Shared keyword recognition for the parser variants. Each variant lists its
+// keywords once in a constexpr Keyword<TokenType> array and builds a
+// KeywordTable from it:
+//
+//     constexpr Keyword<TokenType> keywordList[] = {{"int", T_INT}, {"if", T_IF}};
+//     constexpr auto keywords = makeKeywordTable(keywordList);
+//     static_assert(keywords.valid(), "no perfect hash for the keyword list");
+//
+//     TokenType type = keywords.lookup(word, T_ID);
+//
+// The table is a perfect hash found at compile time, so a lookup costs one
+// hash of (first char, last char, length) and at most one string compare,
+// however many keywords the language has.
+
+template <typename T>
+struct Keyword
+{
+    std::string_view word{};
+    T type{};
+};
+
+template <typename T, std::size_t N>
+class KeywordTable
+{
+public:
+    constexpr KeywordTable(const Keyword<T> (&keywords)[N]) : slots(), seed(0)
+    {
+        for (std::uint32_t candidate = 1; candidate < MAX_SEED; candidate++)
+        {
+            if (tryBuild(keywords, candidate))
+            {
+                seed = candidate;
+                return;
+            }
+        }
+    }
+
+    // False when no collision-free seed exists, e.g. for duplicate keywords
+    constexpr bool valid() const
+    {
+        return seed != 0;
+    }
+
+    // Token type of word if it is a keyword, otherwise fallback
+    constexpr T lookup(std::string_view word, T fallback) const
+    {
+        if (word.empty())
+            return fallback;
+        const Keyword<T> &slot = slots[hash(word, seed)];
+        return slot.word == word ? slot.type : fallback;
+    }
+
+private:
+    static constexpr std::uint32_t MAX_SEED = 1 << 16;
+
+    static constexpr std::size_t tableBits()
+    {
+        std::size_t bits = 3;
+        while ((std::size_t(1) << bits) < 2 * N)
+            bits++;
+        return bits;
+    }
+
+    static constexpr std::size_t BITS = tableBits();
+    static constexpr std::size_t SIZE = std::size_t(1) << BITS;
+
+    Keyword<T> slots[SIZE];
+    std::uint32_t seed;
+
+    // Multiplicative hash of the first char, last char and length
+    static constexpr std::size_t hash(std::string_view word, std::uint32_t seed)
+    {
+        std::uint32_t key = static_cast<unsigned char>(word.front()) |
+                            static_cast<unsigned char>(word.back()) << 8 |
+                            static_cast<std::uint32_t>(word.size()) << 16;
+        return ((key * 0x9E3779B1u) ^ (seed * 0x85EBCA6Bu)) * seed >> (32 - BITS);
+    }
+
+    constexpr bool tryBuild(const Keyword<T> (&keywords)[N], std::uint32_t candidate)
+    {
+        for (std::size_t i = 0; i < SIZE; i++)
+            slots[i] = Keyword<T>{};
+        for (std::size_t i = 0; i < N; i++)
+        {
+            Keyword<T> &slot = slots[hash(keywords[i].word, candidate)];
+            if (!slot.word.empty())
+                return false;
+            slot = keywords[i];
+        }
+        return true;
+    }
+};
+
+template <typename T, std::size_t N>
+constexpr KeywordTable<T, N> makeKeywordTable(const Keyword<T> (&keywords)[N])
+{
+    return KeywordTable<T, N>(keywords);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include "parser.h"
+#include "interpreter.h"
+#include "bytecode.h"
+#include "jit.h"
+
+// Runs loop-heavy programs on the tree-walking Interpreter, on the bytecode
+// VM and on the Interpreter with the loop JIT, checks that all return the
+// same value, and compares times. Also checks that a LoopJit handed a
+// second program runs it correctly rather than with the first one's code.
+//
+// Usage: loop_benchmark [iterations]
+
+using namespace std;
+
+struct Workload
+{
+    const char *name;
+    string source;
+};
+
+template <typename Run>
+double bestSeconds(Run run, int rounds, RunResult &result)
+{
+    double best = 1e30;
+    for (int round = 0; round < rounds; round++)
+    {
+        auto start = chrono::steady_clock::now();
+        result = run();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    string n = argc > 1 ? argv[1] : "10000000";
+    const int rounds = 3;
+    Workload workloads[] = {
+        {"summation", "int s; int i; s = 0;\n"
+                      "for (i = 0; i < " + n + "; i = i + 1) { s = s + i; }\n"
+                      "return s;\n"},
+        {"fizzbuzz sum", "int s; int i; s = 0; i = 0;\n"
+                         "while (i < " + n + ") {\n"
+                         "    if (i / 3 * 3 == i || i / 5 * 5 == i && i > 10) { s = s + i * 2 - 1; } else { s = s - 1; }\n"
+                         "    i = i + 1;\n"
+                         "}\n"
+                         "return s;\n"},
+    };
+
+    for (const Workload &workload : workloads)
+    {
+        ParseResult program = parse(workload.source);
+        if (!program.ok())
+        {
+            cout << workload.name << ": syntax error" << endl;
+            return 1;
+        }
+        Bytecode bytecode = Compiler(program).compile();
+        Interpreter interpreter(program);
+        VirtualMachine vm(bytecode);
+        LoopJit loopJit(program);
+        Interpreter jitInterpreter(program, &loopJit);
+
+        RunResult treeResult, vmResult, jitResult;
+        double tree = bestSeconds([&] { return interpreter.run(); }, rounds, treeResult);
+        double virtualMachine = bestSeconds([&] { return vm.run(); }, rounds, vmResult);
+        double jit = bestSeconds([&] { return jitInterpreter.run(); }, rounds, jitResult);
+        if (treeResult.status != RUN_OK || vmResult.status != RUN_OK || jitResult.status != RUN_OK ||
+            treeResult.value != vmResult.value || treeResult.value != jitResult.value)
+        {
+            cout << workload.name << ": results differ (" << treeResult.value << " vs " << vmResult.value
+                 << " vs " << jitResult.value << ")" << endl;
+            return 1;
+        }
+        cout << workload.name << " (" << n << " iterations, " << bytecode.code.size() << " instructions): "
+             << "tree walker " << tree * 1e3 << " ms, VM " << virtualMachine * 1e3 << " ms ("
+             << tree / virtualMachine << "x), JIT " << jit * 1e3 << " ms (" << tree / jit << "x)" << endl;
+    }
+
+    // Two loops of the same shape, so the second tree can look just like
+    // the first to a cache keyed by node. The JIT is bound to the first
+    // program and must leave the second to the Interpreter.
+    ParseResult first = parse("int s; int i; s = 0; i = 0; while (i < 100) { s = s + i; i = i + 1; } return s;");
+    LoopJit reused(first, 1);
+    RunResult firstResult = Interpreter(first, &reused).run();
+    ParseResult second = parse("int s; int i; s = 0; i = 0; while (i < 100) { s = s + 2; i = i + 1; } return s;");
+    RunResult secondResult = Interpreter(second, &reused).run();
+    if (firstResult.value != Interpreter(first).run().value || secondResult.value != Interpreter(second).run().value ||
+        reused.compiled() != 1)
+    {
+        cout << "reused JIT: ran the wrong code (" << firstResult.value << ", " << secondResult.value << ", "
+             << reused.compiled() << " loops compiled)" << endl;
+        return 1;
+    }
+    return 0;
+}
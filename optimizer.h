@@ -0,0 +1,408 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parser.h"
+
+// Constant folding, constant propagation and dead-branch elimination over
+// the trees built by parser.h, run in place between parsing and any
+// consumer. The rewritten tree means exactly what the original did under
+// the semantics in interpreter.h:
+//
+//   - An operator whose operands are both known becomes an N_NUMBER. It
+//     keeps the operator's token, so read Node::value rather than its text.
+//   - A variable holding a known value at a use becomes an N_NUMBER.
+//     Values are tracked along straight-line code, merged where if arms
+//     rejoin, and forgotten for every variable a loop assigns.
+//   - An if whose condition is known is replaced by the arm that runs, a
+//     while whose condition is known to be false is removed, and
+//     statements after a return in the same list are dropped.
+//   - Division by zero is never folded, so it still fails at run time.
+
+struct OptimizeStats
+{
+    size_t folded;            // Operators and variable uses replaced by constants
+    size_t branchesRemoved;   // Ifs and whiles resolved at compile time
+    size_t statementsRemoved; // Unreachable statements dropped
+};
+
+class Optimizer
+{
+public:
+    // The pass recurses over the tree; deeper subtrees are left as they are
+    static constexpr int MAX_DEPTH = 10000;
+
+    Optimizer(ParseResult &program)
+        : program(program), known(program.slotCount, 0), values(program.slotCount, 0),
+          seen(program.slotCount, 0), generation(0), reachable(true), depth(0), stats() {}
+
+    OptimizeStats run()
+    {
+        if (program.ok())
+        {
+            statementList(&program.root->first);
+        }
+        return stats;
+    }
+
+private:
+    // What is known about one variable before a change, for rolling back
+    struct Change
+    {
+        uint32_t slot;
+        uint8_t known;
+        int64_t value;
+    };
+
+    ParseResult &program;
+    std::vector<uint8_t> known;
+    std::vector<int64_t> values;
+    std::vector<Change> journal; // Every change to known/values, so branches can be undone
+    std::vector<uint32_t> seen;  // Per-slot generation stamps for merging
+    uint32_t generation;
+    bool reachable; // False after a return, until control flow rejoins
+    int depth;
+    OptimizeStats stats;
+
+    void set(uint32_t slot, bool isKnown, int64_t value)
+    {
+        journal.push_back(Change{slot, known[slot], values[slot]});
+        known[slot] = isKnown;
+        values[slot] = value;
+    }
+
+    void rollback(size_t mark)
+    {
+        while (journal.size() > mark)
+        {
+            const Change &change = journal.back();
+            known[change.slot] = change.known;
+            values[change.slot] = change.value;
+            journal.pop_back();
+        }
+    }
+
+    void forgetAll()
+    {
+        for (uint32_t slot = 0; slot < known.size(); slot++)
+        {
+            if (known[slot])
+                set(slot, false, 0);
+        }
+    }
+
+    bool isConstant(const Node *node) const
+    {
+        return node->kind == N_NUMBER;
+    }
+
+    void makeConstant(Node *node, int64_t value)
+    {
+        node->kind = N_NUMBER;
+        node->value = value;
+        node->first = node->second = node->third = nullptr;
+        stats.folded++;
+    }
+
+    Node *emptyBlock(const Token &token)
+    {
+        return program.arena.make<Node>(N_BLOCK, token);
+    }
+
+    // Processes the statements linked from *link, dropping those that
+    // follow a return
+    void statementList(Node **link)
+    {
+        while (*link)
+        {
+            if (!reachable)
+            {
+                for (Node *dead = *link; dead; dead = dead->next)
+                    stats.statementsRemoved++;
+                *link = nullptr;
+                return;
+            }
+            Node *before = *link;
+            statement(link, true);
+            if (*link == before || (*link && *link != before->next))
+            {
+                link = &(*link)->next;
+            }
+        }
+    }
+
+    // Processes the statement at *link, which may be replaced. In a list
+    // (inList) a statement that turns out to do nothing is unlinked, and
+    // *link then holds the following, not yet processed, statement.
+    void statement(Node **link, bool inList)
+    {
+        Node *node = *link;
+        if (depth == MAX_DEPTH)
+        {
+            forgetAll();
+            return;
+        }
+        depth++;
+        switch (node->kind)
+        {
+        case N_BLOCK:
+            statementList(&node->first);
+            break;
+        case N_DECLARATION:
+            set(node->slot, true, 0);
+            break;
+        case N_ASSIGNMENT:
+            expression(node->first);
+            if (isConstant(node->first))
+                set(node->slot, true, node->first->value);
+            else
+                set(node->slot, false, 0);
+            break;
+        case N_RETURN:
+            expression(node->first);
+            reachable = false;
+            break;
+        case N_IF:
+            ifStatement(link, inList);
+            break;
+        case N_WHILE:
+            whileStatement(link, inList);
+            break;
+        default:
+            break;
+        }
+        depth--;
+    }
+
+    // Replaces the statement at *link with replacement, or removes it when
+    // replacement is null
+    void replace(Node **link, Node *replacement, bool inList)
+    {
+        Node *node = *link;
+        if (!replacement)
+        {
+            if (inList)
+            {
+                *link = node->next;
+                return;
+            }
+            replacement = emptyBlock(node->token);
+        }
+        replacement->next = node->next;
+        *link = replacement;
+    }
+
+    void ifStatement(Node **link, bool inList)
+    {
+        Node *node = *link;
+        expression(node->first);
+        if (isConstant(node->first))
+        {
+            stats.branchesRemoved++;
+            Node *taken = node->first->value ? node->second : node->third;
+            replace(link, taken, inList);
+            if (taken)
+                statement(link, inList);
+            return;
+        }
+
+        // Run each arm from the state before the if, then keep only what
+        // both arms agree on
+        size_t before = journal.size();
+        statement(&node->second, false);
+        bool thenReachable = reachable;
+        std::vector<Change> afterThen;
+        for (size_t i = before; i < journal.size(); i++)
+        {
+            uint32_t slot = journal[i].slot;
+            afterThen.push_back(Change{slot, known[slot], values[slot]});
+        }
+        rollback(before);
+
+        reachable = true;
+        size_t elseBegin = journal.size();
+        if (node->third)
+            statement(&node->third, false);
+        bool elseReachable = reachable;
+        size_t elseEnd = journal.size();
+
+        reachable = thenReachable || elseReachable;
+        if (!thenReachable)
+        {
+            return; // Only the else arm continues
+        }
+        if (!elseReachable)
+        {
+            rollback(elseBegin);
+            for (const Change &change : afterThen)
+                set(change.slot, change.known, change.value);
+            return;
+        }
+
+        generation++;
+        for (const Change &change : afterThen)
+        {
+            seen[change.slot] = generation;
+            if (!(change.known && known[change.slot] && values[change.slot] == change.value))
+                set(change.slot, false, 0);
+        }
+        for (size_t i = elseBegin; i < elseEnd; i++)
+        {
+            // Not touched by the then arm, so it still holds the value from
+            // before the if, which is what the journal recorded
+            const Change change = journal[i];
+            if (seen[change.slot] == generation)
+                continue;
+            seen[change.slot] = generation;
+            if (!(change.known && known[change.slot] && values[change.slot] == change.value))
+                set(change.slot, false, 0);
+        }
+    }
+
+    void whileStatement(Node **link, bool inList)
+    {
+        Node *node = *link;
+
+        // Anything the body assigns may differ from one iteration to the
+        // next, including at the condition
+        size_t before = journal.size();
+        std::vector<const Node *> pending{node->second};
+        while (!pending.empty())
+        {
+            const Node *statement = pending.back();
+            pending.pop_back();
+            if (statement->next)
+                pending.push_back(statement->next);
+            switch (statement->kind)
+            {
+            case N_ASSIGNMENT:
+            case N_DECLARATION:
+                if (known[statement->slot])
+                    set(statement->slot, false, 0);
+                break;
+            case N_BLOCK:
+                if (statement->first)
+                    pending.push_back(statement->first);
+                break;
+            case N_IF:
+                pending.push_back(statement->second);
+                if (statement->third)
+                    pending.push_back(statement->third);
+                break;
+            case N_WHILE:
+                pending.push_back(statement->second);
+                break;
+            default:
+                break;
+            }
+        }
+
+        expression(node->first);
+        if (isConstant(node->first) && node->first->value == 0)
+        {
+            stats.branchesRemoved++;
+            rollback(before);
+            replace(link, nullptr, inList);
+            return;
+        }
+
+        size_t bodyStart = journal.size();
+        statement(&node->second, false);
+        rollback(bodyStart);
+        // A loop that never tests false can only be left by a return
+        reachable = !isConstant(node->first);
+    }
+
+    void expression(Node *node)
+    {
+        if (depth == MAX_DEPTH)
+            return;
+        depth++;
+        if (node->kind == N_IDENTIFIER)
+        {
+            if (known[node->slot])
+                makeConstant(node, values[node->slot]);
+        }
+        else if (node->kind == N_BINARY)
+        {
+            binary(node);
+        }
+        depth--;
+    }
+
+    void binary(Node *node)
+    {
+        TokenType op = node->token.type;
+        expression(node->first);
+        expression(node->second);
+        if (!isConstant(node->first))
+            return;
+        int64_t left = node->first->value;
+
+        // The right operand of && and || only runs when the left does not
+        // decide the result, so a deciding left operand folds on its own
+        if (op == T_LOGICAL_AND || op == T_LOGICAL_OR)
+        {
+            bool decided = op == T_LOGICAL_AND ? left == 0 : left != 0;
+            if (decided)
+                makeConstant(node, op == T_LOGICAL_OR);
+            else if (isConstant(node->second))
+                makeConstant(node, node->second->value != 0);
+            return;
+        }
+        if (!isConstant(node->second))
+            return;
+        int64_t right = node->second->value;
+        switch (op)
+        {
+        case T_PLUS:
+            makeConstant(node, int64_t(uint64_t(left) + uint64_t(right)));
+            break;
+        case T_MINUS:
+            makeConstant(node, int64_t(uint64_t(left) - uint64_t(right)));
+            break;
+        case T_MUL:
+            makeConstant(node, int64_t(uint64_t(left) * uint64_t(right)));
+            break;
+        case T_DIV:
+            if (right == -1)
+                makeConstant(node, int64_t(0 - uint64_t(left)));
+            else if (right != 0)
+                makeConstant(node, left / right);
+            break;
+        case T_GT:
+            makeConstant(node, left > right);
+            break;
+        case T_LT:
+            makeConstant(node, left < right);
+            break;
+        case T_GE:
+            makeConstant(node, left >= right);
+            break;
+        case T_LE:
+            makeConstant(node, left <= right);
+            break;
+        case T_EQ:
+        case T_EQUAL:
+            makeConstant(node, left == right);
+            break;
+        case T_NEQ:
+        case T_NOT_EQUAL:
+            makeConstant(node, left != right);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+// Optimizes program in place and reports what changed. Does nothing when
+// the program has syntax errors.
+inline OptimizeStats optimize(ParseResult &program)
+{
+    return Optimizer(program).run();
+}
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef PARALLEL_LEXER_H
+#define PARALLEL_LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "parser.h"
+#include "work_pool.h"
+
+// Everything Lexer::tokenize() produces for one source
+struct TokenizedSource
+{
+    std::vector<Token> tokens;           // Ending with T_EOF
+    Interner identifiers;                // By Token::id, numbered as a single Lexer numbers them
+    std::vector<Diagnostic> diagnostics; // Skipped characters by offset, with locations filled in
+};
+
+// Lexes one large source on several threads, with the same result as a
+// single Lexer's tokenize().
+//
+// The source is cut into byte ranges, each starting just after a newline
+// where one is near, and every range is lexed by its own Lexer on the
+// WorkStealingPool. Those Lexers start speculatively: no token spans a
+// newline in this language, but a range that had to start mid-line may
+// begin inside a token such as "&&" or "==" or an identifier. Stitching
+// the ranges together is sequential and cheap. The Lexer of one range
+// runs on until it finds the first token at or past its end; if the next
+// range also has a token starting exactly there, both scans are in the
+// same state and the next range is taken from that token on. Otherwise
+// the source is re-lexed from that token until it lines up with the
+// speculative tokens again, which takes a token or two.
+//
+// Each range interns identifiers into its own Interner. Afterwards, ranges
+// are merged into one Interner in order, each contributing its names in
+// the order they first appear among its kept tokens. Every token is then
+// copied into the result with its id rewritten, range by range in
+// parallel. Diagnostic line numbers come from per-range newline counts and
+// a prefix sum.
+class ParallelLexer
+{
+public:
+    static constexpr size_t MINIMUM_RANGE = 64 * 1024; // Smaller inputs use fewer ranges
+    static constexpr size_t RANGES_PER_THREAD = 4;     // Slack for work stealing
+
+    ParallelLexer(std::string_view src, size_t threads = std::thread::hardware_concurrency(), ScanMode mode = detectScanMode())
+        : src(src), mode(mode), pool(threads) {}
+
+    TokenizedSource tokenize()
+    {
+        ranges.clear();
+        relexed.clear();
+        pieces.clear();
+        split();
+        if (ranges.size() == 1)
+        {
+            // Nothing to stitch
+            Lexer &lexer = *ranges[0]->lexer;
+            TokenizedSource result{lexer.tokenize(), {}, lexer.diagnostics()};
+            result.identifiers = lexer.identifiers();
+            for (Diagnostic &diagnostic : result.diagnostics)
+                diagnostic.location = lexer.location(diagnostic.offset);
+            return result;
+        }
+        std::vector<size_t> order(ranges.size());
+        for (size_t i = 0; i < ranges.size(); i++)
+            order[i] = i;
+        pool.run(order, [&](size_t range, size_t) {
+            scan(*ranges[range]);
+        });
+        stitch();
+        return merge();
+    }
+
+private:
+    // A byte range of src and the speculative scan of it
+    struct Range
+    {
+        size_t begin; // Where the scan started
+        size_t end;   // Tokens starting here or later belong to the next range
+        size_t stop;  // Offset of the first token at or past end, or src.size()
+        std::vector<Token> tokens;
+        std::unique_ptr<Lexer> lexer; // For its Interner and diagnostics
+    };
+
+    // The part of a Range that made it into the result: its tokens and
+    // diagnostics with offsets in [from, to)
+    struct Piece
+    {
+        const Range *range;
+        size_t from, to;
+        size_t first, last;              // Indices into range->tokens
+        size_t out;                      // Index of the first token in the result
+        std::vector<uint32_t> firstSeen; // The range's ids, in order of first use in [first, last)
+        std::vector<uint32_t> ids;       // Range id -> id in the result
+        size_t newlines;                 // In [from, to)
+    };
+
+    std::string_view src;
+    ScanMode mode;
+    WorkStealingPool pool;
+    std::vector<std::unique_ptr<Range>> ranges;
+    std::vector<std::unique_ptr<Range>> relexed;
+    std::vector<Piece> pieces;
+
+    std::unique_ptr<Range> newRange(size_t begin, size_t end)
+    {
+        auto range = std::make_unique<Range>();
+        range->begin = begin;
+        range->end = end;
+        range->stop = end;
+        range->lexer = std::make_unique<Lexer>(src, mode);
+        range->lexer->seek(begin);
+        return range;
+    }
+
+    // Cuts src into ranges of about equal size, moving each cut forward to
+    // just after a newline unless none comes before the next cut
+    void split()
+    {
+        size_t count = pool.workers() == 1 ? 1 : std::min(pool.workers() * RANGES_PER_THREAD, std::max<size_t>(src.size() / MINIMUM_RANGE, 1));
+        std::vector<size_t> cuts{0};
+        for (size_t i = 1; i < count; i++)
+        {
+            size_t nominal = src.size() * i / count;
+            size_t limit = src.size() * (i + 1) / count;
+            const void *newline = memchr(src.data() + nominal, '\n', limit - nominal);
+            size_t cut = newline ? static_cast<const char *>(newline) - src.data() + 1 : nominal;
+            if (cut > cuts.back() && cut < src.size())
+                cuts.push_back(cut);
+        }
+        cuts.push_back(src.size());
+        for (size_t i = 0; i + 1 < cuts.size(); i++)
+            ranges.push_back(newRange(cuts[i], cuts[i + 1]));
+    }
+
+    void scan(Range &range)
+    {
+        range.tokens.reserve((range.end - range.begin) / 4);
+        for (;;)
+        {
+            Token token = range.lexer->nextToken();
+            if (token.offset >= range.end) // T_EOF is at src.size()
+            {
+                range.stop = token.offset;
+                return;
+            }
+            range.tokens.push_back(token);
+        }
+    }
+
+    static size_t firstAtOrAfter(const std::vector<Token> &tokens, size_t offset)
+    {
+        return std::lower_bound(tokens.begin(), tokens.end(), offset, [](const Token &token, size_t offset) {
+            return token.offset < offset;
+        }) - tokens.begin();
+    }
+
+    void keep(const Range &range, size_t from, size_t to)
+    {
+        Piece piece{&range, from, to, firstAtOrAfter(range.tokens, from), firstAtOrAfter(range.tokens, to), 0, {}, {}, 0};
+        pieces.push_back(std::move(piece));
+    }
+
+    // Decides which speculative tokens to keep, re-lexing where a range did
+    // not start in step with the one before it. cursor is always where a
+    // scan from the start of src has a token (or src.size()).
+    void stitch()
+    {
+        size_t cursor = 0;
+        for (const std::unique_ptr<Range> &range : ranges)
+        {
+            if (cursor >= range->stop)
+                continue; // Already covered by re-lexing
+            size_t first = firstAtOrAfter(range->tokens, cursor);
+            if (range->begin == 0 || (first < range->tokens.size() && range->tokens[first].offset == cursor))
+            {
+                keep(*range, cursor, range->stop);
+                cursor = range->stop;
+                continue;
+            }
+
+            std::unique_ptr<Range> redo = newRange(cursor, range->end);
+            size_t resume = SIZE_MAX;
+            for (;;)
+            {
+                Token token = redo->lexer->nextToken();
+                if (token.offset >= range->end)
+                {
+                    redo->stop = token.offset;
+                    break;
+                }
+                size_t match = firstAtOrAfter(range->tokens, token.offset);
+                if (match < range->tokens.size() && range->tokens[match].offset == token.offset)
+                {
+                    redo->stop = resume = token.offset;
+                    break;
+                }
+                redo->tokens.push_back(token);
+            }
+            keep(*redo, cursor, redo->stop);
+            if (resume != SIZE_MAX)
+            {
+                keep(*range, resume, range->stop);
+                cursor = range->stop;
+            }
+            else
+            {
+                cursor = redo->stop;
+            }
+            relexed.push_back(std::move(redo));
+        }
+    }
+
+    TokenizedSource merge()
+    {
+        TokenizedSource result;
+        bool located = false;
+        size_t total = 0;
+        for (Piece &piece : pieces)
+        {
+            piece.out = total;
+            total += piece.last - piece.first;
+            for (const Diagnostic &diagnostic : piece.range->lexer->diagnostics())
+            {
+                if (diagnostic.offset >= piece.from && diagnostic.offset < piece.to)
+                {
+                    result.diagnostics.push_back(diagnostic);
+                    located = true;
+                }
+            }
+        }
+
+        std::vector<size_t> order(pieces.size());
+        for (size_t i = 0; i < pieces.size(); i++)
+            order[i] = i;
+        pool.run(order, [&](size_t index, size_t) {
+            Piece &piece = pieces[index];
+            std::vector<char> seen(piece.range->lexer->identifiers().size());
+            for (size_t i = piece.first; i < piece.last; i++)
+            {
+                const Token &token = piece.range->tokens[i];
+                if (token.type == T_ID && !seen[token.id])
+                {
+                    seen[token.id] = 1;
+                    piece.firstSeen.push_back(token.id);
+                }
+            }
+            if (located)
+                piece.newlines = std::count(src.data() + piece.from, src.data() + piece.to, '\n');
+        });
+
+        for (Piece &piece : pieces)
+        {
+            const Interner &names = piece.range->lexer->identifiers();
+            piece.ids.resize(names.size());
+            for (uint32_t id : piece.firstSeen)
+                piece.ids[id] = result.identifiers.intern(names.spelling(id));
+        }
+
+        result.tokens.resize(total + 1);
+        pool.run(order, [&](size_t index, size_t) {
+            const Piece &piece = pieces[index];
+            Token *out = result.tokens.data() + piece.out;
+            for (size_t i = piece.first; i < piece.last; i++)
+            {
+                Token token = piece.range->tokens[i];
+                if (token.type == T_ID)
+                    token.id = piece.ids[token.id];
+                *out++ = token;
+            }
+        });
+        result.tokens[total] = Token{T_EOF, src.size(), 0};
+
+        if (located)
+            locate(result.diagnostics);
+        return result;
+    }
+
+    // Pieces tile src in order, so a prefix sum of their newline counts
+    // gives the line each one starts on. Within a piece, the diagnostics
+    // are located in one scan from its start.
+    void locate(std::vector<Diagnostic> &diagnostics)
+    {
+        int line = 1;
+        size_t next = 0;
+        for (const Piece &piece : pieces)
+        {
+            if (next < diagnostics.size() && diagnostics[next].offset < piece.to)
+            {
+                int current = line;
+                size_t lineStart = piece.from;
+                while (lineStart > 0 && src[lineStart - 1] != '\n')
+                    lineStart--;
+                size_t scanned = piece.from;
+                for (; next < diagnostics.size() && diagnostics[next].offset < piece.to; next++)
+                {
+                    size_t offset = diagnostics[next].offset;
+                    while (const void *newline = memchr(src.data() + scanned, '\n', offset - scanned))
+                    {
+                        scanned = static_cast<const char *>(newline) - src.data() + 1;
+                        lineStart = scanned;
+                        current++;
+                    }
+                    scanned = offset;
+                    diagnostics[next].location = SourceLocation{current, int(offset - lineStart + 1)};
+                }
+            }
+            line += int(piece.newlines);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "parser.h"
+#include "parallel_lexer.h"
+#include "work_pool.h"
+
+// Serves the tokens of a TokenizedSource to a BasicParser, starting at any
+// index. Past the end it keeps returning the final T_EOF, as a Lexer does.
+class TokenReader
+{
+public:
+    TokenReader(const TokenizedSource &tokenized, std::string_view src, size_t start)
+        : tokens(tokenized.tokens.data()), last(tokenized.tokens.size() - 1), index(std::min(start, last)), src(src) {}
+
+    Token nextToken()
+    {
+        Token token = tokens[index];
+        if (index < last)
+            index++;
+        return token;
+    }
+
+    std::string_view text(const Token &token) const
+    {
+        return src.substr(token.offset, token.length);
+    }
+
+private:
+    const Token *tokens;
+    size_t last; // The T_EOF
+    size_t index;
+    std::string_view src;
+};
+
+// Settles the deferred slots of the parts of a program (see SlotOrigin),
+// one part after another in program order, numbering every slot as a
+// single parse() of the whole program would.
+class TopLevelNames
+{
+public:
+    TopLevelNames(std::string_view src, size_t identifiers)
+        : src(src), topLevel(identifiers, Binding{SymbolTable::NONE, false}), count(0) {}
+
+    // Fills slots with the number of each slot of the next part and appends
+    // to errors the semantic errors that depended on the parts before
+    void settle(const std::vector<DeferredSlot> &part, std::vector<uint32_t> &slots, std::vector<Diagnostic> &errors)
+    {
+        slots.resize(part.size());
+        for (uint32_t slot = 0; slot < part.size(); slot++)
+        {
+            const DeferredSlot &deferred = part[slot];
+            Binding &earlier = topLevel[deferred.name.id];
+            auto report = [&](DiagnosticCode code, std::string message) {
+                if (deferred.report)
+                    errors.push_back({code, deferred.name.offset, std::move(message), {}});
+            };
+            switch (deferred.origin)
+            {
+            case SLOT_LOCAL:
+                slots[slot] = count++;
+                break;
+            case SLOT_TOP_LEVEL:
+                if (earlier.slot != SymbolTable::NONE && !earlier.implicit)
+                {
+                    report(DIAG_REDECLARED_VARIABLE, redeclaredMessage(text(deferred.name)));
+                    slots[slot] = earlier.slot;
+                }
+                else
+                {
+                    slots[slot] = count++;
+                    earlier = Binding{slots[slot], false};
+                }
+                break;
+            case SLOT_UNRESOLVED:
+                if (earlier.slot != SymbolTable::NONE)
+                {
+                    slots[slot] = earlier.slot;
+                }
+                else
+                {
+                    report(DIAG_UNDECLARED_VARIABLE, undeclaredMessage(text(deferred.name)));
+                    slots[slot] = count++;
+                    if (deferred.depth == 0)
+                        earlier = Binding{slots[slot], true};
+                }
+                break;
+            }
+        }
+    }
+
+    // Slots numbered so far
+    uint32_t slotCount() const
+    {
+        return count;
+    }
+
+private:
+    // As in SymbolTable, an undeclared name is bound where it is first used
+    struct Binding
+    {
+        uint32_t slot;
+        bool implicit;
+    };
+
+    std::string_view src;
+    std::vector<Binding> topLevel; // By id
+    uint32_t count;
+
+    std::string_view text(const Token &token) const
+    {
+        return src.substr(token.offset, token.length);
+    }
+};
+
+// Parses one source on several threads, with the same tree, slots and
+// diagnostics as parse().
+//
+// At the top level a program is a flat list of statements, and a statement
+// ends at a ';' or '}' that leaves brace and parenthesis depth at 0 and is
+// not followed by else. Depth is floored at 0, since parsing goes on at
+// the top level after a stray '}' or ')'. The token array from
+// ParallelLexer is cut into segments at such boundaries, found with a
+// two-pass prefix sum of depth: every chunk of tokens sums its depth
+// changes and notes its lowest running sum, a scan over those pairs gives
+// the depth at each chunk start, and every chunk then looks for the first
+// boundary in it.
+//
+// Each segment is parsed by its own BasicParser into its own Arena, with
+// top-level names deferred (see SlotOrigin). A segment's parse is kept only
+// if the segment before ended exactly where it begins and was not
+// recovering from a syntax error. Otherwise that earlier parser, which
+// is in the same state as parse() would be, carries on over the segment
+// itself, so input with errors costs some parallelism but not accuracy.
+// The kept parts are then merged in order:
+// - Their deferred slots are settled by TopLevelNames against the top-level
+//   names of the parts before, renumbering every slot as parse() numbers it and adding
+//   the semantic errors that depended on earlier parts.
+// - Their statement lists are linked, and their arenas adopted by the result.
+//
+// In an instrumented build, lexSeconds is the time ParallelLexer took and
+// parseSeconds the whole parse, both wall-clock; the depths are the
+// deepest of any part.
+class ParallelParser
+{
+public:
+    static constexpr size_t MINIMUM_SEGMENT = 16 * 1024; // Tokens; smaller inputs use fewer segments
+    static constexpr size_t SEGMENTS_PER_THREAD = 4;
+
+    ParallelParser(std::string_view src, size_t threads = std::thread::hardware_concurrency())
+        : src(src), pool(threads) {}
+
+    ParseResult parseProgram()
+    {
+        if (pool.workers() == 1)
+        {
+            // Nothing to split; materializing the tokens would only cost time
+            Lexer lexer(src);
+            Parser parser(lexer);
+            return parser.parseProgram();
+        }
+#ifdef PARSER_INSTRUMENTATION
+        auto start = std::chrono::steady_clock::now();
+#endif
+        tokenized = ParallelLexer(src, pool.workers()).tokenize();
+#ifdef PARSER_INSTRUMENTATION
+        double lexSeconds = secondsSince(start);
+#endif
+        std::vector<size_t> cuts = statementBoundaries();
+        segments.clear();
+        for (size_t i = 0; i < cuts.size(); i++)
+        {
+            size_t end = i + 1 < cuts.size() ? cuts[i + 1] : tokenized.tokens.size() - 1;
+            segments.push_back(std::make_unique<Segment>(tokenized, src, cuts[i], end));
+        }
+        std::vector<size_t> order(segments.size());
+        for (size_t i = 0; i < segments.size(); i++)
+            order[i] = i;
+        pool.run(order, [&](size_t index, size_t) {
+            Segment &segment = *segments[index];
+            segment.parser.parseStatements(limit(segment.end));
+        });
+#ifdef PARSER_INSTRUMENTATION
+        ParseResult result = merge(stitch());
+        result.metrics.lexSeconds = lexSeconds;
+        result.metrics.parseSeconds = secondsSince(start);
+        return result;
+#else
+        return merge(stitch());
+#endif
+    }
+
+private:
+    // A run of top-level statements from token begin up to token end
+    struct Segment
+    {
+        size_t begin, end;
+        TokenReader reader;
+        BasicParser<TokenReader> parser;
+
+        Segment(const TokenizedSource &tokenized, std::string_view src, size_t begin, size_t end)
+            : begin(begin), end(end), reader(tokenized, src, begin), parser(reader)
+        {
+            parser.deferTopLevelNames();
+        }
+    };
+
+    std::string_view src;
+    WorkStealingPool pool;
+    TokenizedSource tokenized;
+    std::vector<std::unique_ptr<Segment>> segments;
+
+    // Offset before which a segment's statements must start
+    size_t limit(size_t token) const
+    {
+        return token + 1 < tokenized.tokens.size() ? tokenized.tokens[token].offset : SIZE_MAX;
+    }
+
+    static int depthChange(TokenType type)
+    {
+        return type == T_LBRACE || type == T_LPAREN ? 1 : type == T_RBRACE || type == T_RPAREN ? -1 : 0;
+    }
+
+    // Token indices where segments start, the first being 0
+    std::vector<size_t> statementBoundaries()
+    {
+        const std::vector<Token> &tokens = tokenized.tokens;
+        size_t count = std::min(pool.workers() * SEGMENTS_PER_THREAD, std::max<size_t>(tokens.size() / MINIMUM_SEGMENT, 1));
+        if (pool.workers() == 1)
+            count = 1;
+        std::vector<long> sums(count), lowest(count), depthAtStart(count, 0);
+        std::vector<size_t> cuts(count, 0);
+        std::vector<size_t> chunks(count);
+        for (size_t i = 0; i < count; i++)
+            chunks[i] = i;
+        auto chunkStart = [&](size_t chunk) {
+            return tokens.size() * chunk / count;
+        };
+
+        pool.run(chunks, [&](size_t chunk, size_t) {
+            long sum = 0, low = 0;
+            for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i++)
+            {
+                sum += depthChange(tokens[i].type);
+                low = std::min(low, sum);
+            }
+            sums[chunk] = sum;
+            lowest[chunk] = low;
+        });
+        // Entering a chunk at depth d, the floor is hit when d + lowest < 0
+        for (size_t i = 1; i < count; i++)
+        {
+            long entry = depthAtStart[i - 1];
+            depthAtStart[i] = entry + sums[i - 1] - std::min(0L, entry + lowest[i - 1]);
+        }
+        pool.run(chunks, [&](size_t chunk, size_t) {
+            long depth = depthAtStart[chunk];
+            for (size_t i = chunkStart(chunk); i + 1 < chunkStart(chunk + 1); i++)
+            {
+                depth = std::max(0L, depth + depthChange(tokens[i].type));
+                if (chunk > 0 && depth == 0 && (tokens[i].type == T_SEMICOLON || tokens[i].type == T_RBRACE) &&
+                    tokens[i + 1].type != T_ELSE)
+                {
+                    cuts[chunk] = i + 1;
+                    return;
+                }
+            }
+        });
+
+        std::vector<size_t> boundaries{0};
+        for (size_t cut : cuts)
+        {
+            if (cut > boundaries.back())
+                boundaries.push_back(cut);
+        }
+        return boundaries;
+    }
+
+    // Chooses the segments whose speculative parse holds, letting the
+    // parser before each rejected one parse its range instead. Returns the
+    // kept segments in order.
+    std::vector<Segment *> stitch()
+    {
+        std::vector<Segment *> kept{segments[0].get()};
+        Segment *current = segments[0].get();
+        for (size_t i = 1; i < segments.size(); i++)
+        {
+            Segment &next = *segments[i];
+            if (!current->parser.recovering() && current->parser.position() == limit(next.begin))
+            {
+                kept.push_back(&next);
+                current = &next;
+                continue;
+            }
+            current->parser.parseStatements(limit(next.end));
+        }
+        return kept;
+    }
+
+    ParseResult merge(const std::vector<Segment *> &kept)
+    {
+        std::vector<ParsedPart> parts;
+        for (Segment *segment : kept)
+            parts.push_back(segment->parser.takePart());
+        Arena arena;
+        Node *program = arena.make<Node>(N_PROGRAM, tokenized.tokens.front());
+        Node **tail = &program->first;
+        std::vector<Diagnostic> all = tokenized.diagnostics;
+        std::vector<std::vector<uint32_t>> slotMaps(parts.size());
+
+        // Settle the deferred slots in program order
+        TopLevelNames names(src, tokenized.identifiers.size());
+        for (size_t p = 0; p < parts.size(); p++)
+        {
+            ParsedPart &part = parts[p];
+            names.settle(part.slots, slotMaps[p], part.errors);
+            for (Diagnostic &error : part.errors)
+                all.push_back(std::move(error));
+            if (part.statements)
+            {
+                *tail = part.statements;
+                while (*tail)
+                    tail = &(*tail)->next;
+            }
+        }
+
+        std::vector<size_t> order(parts.size());
+        for (size_t i = 0; i < parts.size(); i++)
+            order[i] = i;
+        pool.run(order, [&](size_t p, size_t) {
+            for (Node *node : parts[p].named)
+                node->slot = slotMaps[p][node->slot];
+        });
+        for (ParsedPart &part : parts)
+            arena.absorb(std::move(part.arena));
+
+        std::stable_sort(all.begin(), all.end(), [](const Diagnostic &a, const Diagnostic &b) {
+            return a.offset < b.offset;
+        });
+        LineIndex lines(src);
+        for (Diagnostic &diagnostic : all)
+            diagnostic.location = lines.locate(diagnostic.offset);
+#ifdef PARSER_INSTRUMENTATION
+        ParseMetrics metrics;
+        metrics.bytes = src.size();
+        for (const Token &token : tokenized.tokens)
+            metrics.tokens[token.type]++;
+        for (const ParsedPart &part : parts)
+        {
+            metrics.maxStatementDepth = std::max(metrics.maxStatementDepth, part.maxStatementDepth);
+            metrics.maxExpressionDepth = std::max(metrics.maxExpressionDepth, part.maxExpressionDepth);
+        }
+        metrics.bytesAllocated = arena.bytesRequested();
+        return ParseResult{std::move(arena), program, std::move(all), src, names.slotCount(), metrics};
+#else
+        return ParseResult{std::move(arena), program, std::move(all), src, names.slotCount()};
+#endif
+    }
+};
+
+// Parses a whole program on several threads; see ParallelParser
+inline ParseResult parseParallel(std::string_view source, size_t threads = std::thread::hardware_concurrency())
+{
+    return ParallelParser(source, threads).parseProgram();
+}
+
+#endif
@@ -0,0 +1,1674 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "keywords.h"
+
+#ifdef PARSER_INSTRUMENTATION
+#include <chrono>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LEXER_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Lexer, parser and AST for the language of updated_parser_7.cpp.
+//
+// Library use: parse() below checks a source buffer in one call. Nothing in
+// this header prints, exits or keeps global mutable state, so any number of
+// threads may parse different inputs at the same time.
+//
+// Instrumentation is opt-in: build with -DPARSER_INSTRUMENTATION and every
+// ParseResult carries a ParseMetrics (see below). Without it the metrics
+// type and all the code that fills it are compiled out.
+
+enum TokenType
+{
+    T_INT,
+    T_ID,
+    T_NUM,
+    T_IF,
+    T_ELSE,
+    T_RETURN,
+    T_ASSIGN,
+    T_PLUS,
+    T_MINUS,
+    T_MUL,
+    T_DIV,
+    T_GT,
+    T_LT,
+    T_EQ,
+    T_LE,
+    T_GE,
+    T_NEQ,
+    T_AND,
+    T_OR,
+    T_LPAREN,
+    T_RPAREN,
+    T_LBRACE,
+    T_RBRACE,
+    T_COMMA,
+    T_FOR,
+    T_WHILE,
+    T_DO,
+    T_BREAK,
+    T_CONTINUE,
+    T_SEMICOLON,
+    T_EOF,
+    T_FLOAT,
+    T_STRING,
+    T_LOGICAL_AND, // Add logical AND token
+    T_LOGICAL_OR,  // Add logical OR token
+    T_EQUAL,       // Add equality token
+    T_NOT_EQUAL,   // Add not equal token
+    T_COUNT,       // Number of token types, for tables indexed by TokenType
+};
+
+#ifdef PARSER_INSTRUMENTATION
+// Where the time and memory of one parse went. The Lexer counts tokens and
+// times nextToken(), so an instrumented build pays two clock reads per
+// token; the Parser adds its own time, nesting and arena size.
+struct ParseMetrics
+{
+    double readSeconds = 0;  // Loading the source, when the caller times it
+    double lexSeconds = 0;   // Inside Lexer::nextToken()
+    double parseSeconds = 0; // Parser::parseProgram(), lexing included
+    uint64_t bytes = 0;      // Source length
+    uint64_t tokens[T_COUNT] = {};
+    uint32_t maxStatementDepth = 0;  // Most statements open at once (the parser's frame stack)
+    uint32_t maxExpressionDepth = 0; // Most operators and '(' pending at once
+    uint64_t bytesAllocated = 0;     // Requested from the tree's Arena (see Arena::bytesRequested())
+
+    // Accumulates another parse, e.g. for a batch of files
+    void add(const ParseMetrics &other)
+    {
+        readSeconds += other.readSeconds;
+        lexSeconds += other.lexSeconds;
+        parseSeconds += other.parseSeconds;
+        bytes += other.bytes;
+        for (int type = 0; type < T_COUNT; type++)
+            tokens[type] += other.tokens[type];
+        maxStatementDepth = std::max(maxStatementDepth, other.maxStatementDepth);
+        maxExpressionDepth = std::max(maxExpressionDepth, other.maxExpressionDepth);
+        bytesAllocated += other.bytesAllocated;
+    }
+
+    // One JSON object; token counts are keyed by TokenType name and zero
+    // counts are left out
+    std::string json() const
+    {
+        static const char *names[] = {
+            "T_INT", "T_ID", "T_NUM", "T_IF", "T_ELSE", "T_RETURN", "T_ASSIGN", "T_PLUS", "T_MINUS",
+            "T_MUL", "T_DIV", "T_GT", "T_LT", "T_EQ", "T_LE", "T_GE", "T_NEQ", "T_AND", "T_OR",
+            "T_LPAREN", "T_RPAREN", "T_LBRACE", "T_RBRACE", "T_COMMA", "T_FOR", "T_WHILE", "T_DO",
+            "T_BREAK", "T_CONTINUE", "T_SEMICOLON", "T_EOF", "T_FLOAT", "T_STRING", "T_LOGICAL_AND",
+            "T_LOGICAL_OR", "T_EQUAL", "T_NOT_EQUAL"};
+        static_assert(sizeof names / sizeof *names == T_COUNT, "a TokenType is missing its name");
+        std::string out = "{\"read_seconds\":" + std::to_string(readSeconds) +
+                          ",\"lex_seconds\":" + std::to_string(lexSeconds) +
+                          ",\"parse_seconds\":" + std::to_string(parseSeconds) +
+                          ",\"bytes\":" + std::to_string(bytes) +
+                          ",\"max_statement_depth\":" + std::to_string(maxStatementDepth) +
+                          ",\"max_expression_depth\":" + std::to_string(maxExpressionDepth) +
+                          ",\"bytes_allocated\":" + std::to_string(bytesAllocated) + ",\"tokens\":{";
+        const char *separator = "";
+        for (int type = 0; type < T_COUNT; type++)
+        {
+            if (tokens[type])
+            {
+                out += std::string(separator) + "\"" + names[type] + "\":" + std::to_string(tokens[type]);
+                separator = ",";
+            }
+        }
+        return out + "}}";
+    }
+};
+
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+constexpr Keyword<TokenType> keywordList[] = {
+    {"int", T_INT},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+    {"while", T_WHILE},
+    {"for", T_FOR},
+};
+constexpr auto keywords = makeKeywordTable(keywordList);
+static_assert(keywords.valid(), "no perfect hash for the keyword list");
+
+// A token only records where it sits in the Lexer's source. Its spelling
+// comes from Lexer::text() and its line and column from Lexer::location(),
+// which are only needed when a diagnostic is printed.
+struct Token
+{
+    TokenType type;
+    uint32_t length;
+    size_t offset;
+    uint32_t id; // T_ID: the spelling's id in the Lexer's Interner
+
+    Token() : type(T_EOF), length(0), offset(0), id(0) {}
+    Token(TokenType type, size_t offset, size_t length, uint32_t id = 0)
+        : type(type), length(uint32_t(length)), offset(offset), id(id) {}
+};
+
+struct SourceLocation
+{
+    int line;
+    int column;
+};
+
+enum DiagnosticCode
+{
+    DIAG_UNEXPECTED_CHARACTER, // No token starts with this character
+    DIAG_UNEXPECTED_TOKEN,     // A token that cannot start a statement or operand
+    DIAG_EXPECTED_TOKEN,       // A specific token was required here
+    DIAG_UNDECLARED_VARIABLE,  // A name used with no declaration in scope
+    DIAG_REDECLARED_VARIABLE,  // A name declared twice in the same block
+};
+
+// A problem found in the source. The lexer and parser record only the
+// offset; Parser::parseProgram() fills in location for the final list.
+struct Diagnostic
+{
+    DiagnosticCode code;
+    size_t offset;
+    std::string message;
+    SourceLocation location;
+};
+
+// Offsets where each line of a source starts, built on demand. The index only
+// grows as far as the furthest offset looked up, so an input without errors
+// never scans for newlines, and resolving diagnostics in source order is a
+// single pass overall.
+class LineIndex
+{
+public:
+    LineIndex(std::string_view src) : src(src), scanned(0), lineStarts(1, 0) {}
+
+    SourceLocation locate(size_t offset)
+    {
+        offset = std::min(offset, src.size());
+        while (scanned < offset)
+        {
+            const void *newline = memchr(src.data() + scanned, '\n', offset - scanned);
+            if (!newline)
+            {
+                scanned = offset;
+                break;
+            }
+            scanned = static_cast<const char *>(newline) - src.data() + 1;
+            lineStarts.push_back(scanned);
+        }
+        size_t line = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin();
+        return SourceLocation{int(line), int(offset - lineStarts[line - 1] + 1)};
+    }
+
+private:
+    std::string_view src;
+    size_t scanned; // Every newline before this offset is in lineStarts
+    std::vector<size_t> lineStarts;
+};
+
+// Character classes for the lexer, matching isspace/isdigit/isalpha in the
+// "C" locale but without the locale lookup, so the scanners below inline
+enum CharClass : unsigned char
+{
+    CHAR_OTHER,
+    CHAR_SPACE,
+    CHAR_DIGIT,
+    CHAR_ALPHA,
+};
+
+struct CharClassTable
+{
+    unsigned char classes[256];
+
+    constexpr CharClassTable() : classes()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if (c == ' ' || (c >= '\t' && c <= '\r'))
+                classes[c] = CHAR_SPACE;
+            else if (c >= '0' && c <= '9')
+                classes[c] = CHAR_DIGIT;
+            else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+                classes[c] = CHAR_ALPHA;
+        }
+    }
+};
+
+constexpr CharClassTable charClasses;
+
+inline CharClass charClass(char c)
+{
+    return CharClass(charClasses.classes[static_cast<unsigned char>(c)]);
+}
+
+// Scanning kernels used by the Lexer. Each one starts at pos and returns the
+// end of the run it skips, reading whole 16/32 byte blocks while they fit in
+// the buffer and finishing byte by byte.
+enum ScanMode
+{
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+};
+
+inline size_t skipWhitespaceScalar(const char *src, size_t pos, size_t size)
+{
+    while (pos < size && charClass(src[pos]) == CHAR_SPACE)
+        pos++;
+    return pos;
+}
+
+inline size_t skipAlnumScalar(const char *src, size_t pos, size_t size)
+{
+    while (pos < size && charClass(src[pos]) >= CHAR_DIGIT)
+        pos++;
+    return pos;
+}
+
+inline size_t skipDigitsScalar(const char *src, size_t pos, size_t size)
+{
+    while (pos < size && charClass(src[pos]) == CHAR_DIGIT)
+        pos++;
+    return pos;
+}
+
+#ifdef LEXER_SIMD
+// (c - low) <= span as unsigned bytes, i.e. low <= c <= low + span
+inline __m128i inRange16(__m128i c, char low, char span)
+{
+    __m128i offset = _mm_sub_epi8(c, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(span)), _mm_setzero_si128());
+}
+
+inline size_t skipWhitespaceSSE2(const char *src, size_t pos, size_t size)
+{
+    while (pos + 16 <= size)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), inRange16(c, '\t', '\r' - '\t'));
+        uint32_t spaces = _mm_movemask_epi8(space);
+        if (spaces != 0xFFFF)
+            return pos + __builtin_ctz(~spaces);
+        pos += 16;
+    }
+    return skipWhitespaceScalar(src, pos, size);
+}
+
+inline size_t skipAlnumSSE2(const char *src, size_t pos, size_t size)
+{
+    while (pos + 16 <= size)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+        __m128i alpha = inRange16(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+        __m128i alnum = _mm_or_si128(alpha, inRange16(c, '0', '9' - '0'));
+        uint32_t mask = _mm_movemask_epi8(alnum);
+        if (mask != 0xFFFF)
+            return pos + __builtin_ctz(~mask);
+        pos += 16;
+    }
+    return skipAlnumScalar(src, pos, size);
+}
+
+inline size_t skipDigitsSSE2(const char *src, size_t pos, size_t size)
+{
+    while (pos + 16 <= size)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+        uint32_t mask = _mm_movemask_epi8(inRange16(c, '0', '9' - '0'));
+        if (mask != 0xFFFF)
+            return pos + __builtin_ctz(~mask);
+        pos += 16;
+    }
+    return skipDigitsScalar(src, pos, size);
+}
+
+__attribute__((target("avx2"))) inline size_t skipWhitespaceAVX2(const char *src, size_t pos, size_t size)
+{
+    while (pos + 32 <= size)
+    {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + pos));
+        __m256i control = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+        control = _mm256_cmpeq_epi8(_mm256_subs_epu8(control, _mm256_set1_epi8('\r' - '\t')), _mm256_setzero_si256());
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), control);
+        uint32_t spaces = _mm256_movemask_epi8(space);
+        if (spaces != 0xFFFFFFFF)
+            return pos + __builtin_ctz(~spaces);
+        pos += 32;
+    }
+    return skipWhitespaceSSE2(src, pos, size);
+}
+
+inline ScanMode detectScanMode()
+{
+    return __builtin_cpu_supports("avx2") ? SCAN_AVX2 : SCAN_SSE2;
+}
+#else
+inline ScanMode detectScanMode()
+{
+    return SCAN_SCALAR;
+}
+#endif
+
+// Distinct identifier spellings, numbered densely from 0 in order of first
+// appearance. The Lexer interns every T_ID as it scans it, so later stages
+// compare and index identifiers by id instead of by string. Spellings are
+// views into the source and are not copied.
+class Interner
+{
+public:
+    Interner() : table(INITIAL_CAPACITY, EMPTY) {}
+
+    uint32_t intern(std::string_view name)
+    {
+        uint32_t hash = hashOf(name);
+        size_t mask = table.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            uint64_t entry = table[i];
+            if (entry == EMPTY)
+            {
+                uint32_t id = uint32_t(names.size());
+                names.push_back(name);
+                table[i] = uint64_t(hash) << 32 | id;
+                if (names.size() * 2 > table.size())
+                    grow();
+                return id;
+            }
+            uint32_t id = uint32_t(entry);
+            if (uint32_t(entry >> 32) == hash && names[id] == name)
+                return id;
+        }
+    }
+
+    std::string_view spelling(uint32_t id) const
+    {
+        return names[id];
+    }
+
+    uint32_t size() const
+    {
+        return uint32_t(names.size());
+    }
+
+private:
+    static constexpr uint64_t EMPTY = ~uint64_t(0);
+    static constexpr size_t INITIAL_CAPACITY = 64; // Must be a power of two
+
+    std::vector<std::string_view> names;
+    // Hash in the high half and id in the low half, so most probes are
+    // settled without touching names. Linear probing, at most half full.
+    std::vector<uint64_t> table;
+
+    // FNV-1a
+    static uint32_t hashOf(std::string_view name)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : name)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        return hash;
+    }
+
+    void grow()
+    {
+        std::vector<uint64_t> old(table.size() * 2, EMPTY);
+        old.swap(table);
+        size_t mask = table.size() - 1;
+        for (uint64_t entry : old)
+        {
+            if (entry == EMPTY)
+                continue;
+            size_t i = (entry >> 32) & mask;
+            while (table[i] != EMPTY)
+                i = (i + 1) & mask;
+            table[i] = entry;
+        }
+    }
+};
+
+class Lexer
+{
+private:
+    std::string_view src; // Not owned
+    size_t pos;
+    ScanMode mode;
+    LineIndex lines;
+    std::vector<Diagnostic> errors;
+    Interner names;
+#ifdef PARSER_INSTRUMENTATION
+    ParseMetrics stats;
+#endif
+
+public:
+    // src is not copied and must outlive the Lexer and every token
+    Lexer(std::string_view src, ScanMode mode = detectScanMode())
+        : src(src), pos(0), mode(mode), lines(src) {}
+
+    // Scans and returns the next token. Once src is exhausted every call
+    // returns T_EOF. A character that cannot start a token is recorded in
+    // diagnostics() and skipped.
+    Token nextToken()
+    {
+#ifdef PARSER_INSTRUMENTATION
+        auto start = std::chrono::steady_clock::now();
+        Token token = scanToken();
+        stats.lexSeconds += secondsSince(start);
+        stats.tokens[token.type]++;
+        return token;
+#else
+        return scanToken();
+#endif
+    }
+
+    Token scanToken()
+    {
+        for (;;)
+        {
+            skipWhitespace();
+            size_t start = pos;
+            if (pos >= src.size())
+            {
+                return Token{T_EOF, start, 0};
+            }
+
+            char current = src[pos];
+            CharClass kind = charClass(current);
+            if (kind == CHAR_DIGIT)
+            {
+                return Token{T_NUM, start, consumeNumber().size()};
+            }
+            if (kind == CHAR_ALPHA)
+            {
+                std::string_view word = consumeWord();
+                TokenType type = keywords.lookup(word, T_ID);
+                return Token{type, start, word.size(), type == T_ID ? names.intern(word) : 0};
+            }
+
+            TokenType type;
+            size_t length = 1;
+            switch (current)
+            {
+            case '+':
+                type = T_PLUS;
+                break;
+            case '-':
+                type = T_MINUS;
+                break;
+            case '*':
+                type = T_MUL;
+                break;
+            case '/':
+                type = T_DIV;
+                break;
+            case '(':
+                type = T_LPAREN;
+                break;
+            case ')':
+                type = T_RPAREN;
+                break;
+            case '{':
+                type = T_LBRACE;
+                break;
+            case '}':
+                type = T_RBRACE;
+                break;
+            case ';':
+                type = T_SEMICOLON;
+                break;
+            case '>':
+                if (peekChar(1) == '=')
+                {
+                    type = T_GE;
+                    length = 2;
+                }
+                else
+                {
+                    type = T_GT;
+                }
+                break;
+            case '<':
+                if (peekChar(1) == '=')
+                {
+                    type = T_LE;
+                    length = 2;
+                }
+                else
+                {
+                    type = T_LT;
+                }
+                break;
+            case '&':
+                if (peekChar(1) != '&')
+                {
+                    unexpectedCharacter(current);
+                    continue;
+                }
+                type = T_LOGICAL_AND;
+                length = 2;
+                break;
+            case '|':
+                if (peekChar(1) != '|')
+                {
+                    unexpectedCharacter(current);
+                    continue;
+                }
+                type = T_LOGICAL_OR;
+                length = 2;
+                break;
+            case '=':
+                if (peekChar(1) == '=')
+                {
+                    type = T_EQUAL;
+                    length = 2;
+                }
+                else
+                {
+                    type = T_ASSIGN;
+                }
+                break;
+            case '!':
+                if (peekChar(1) != '=')
+                {
+                    unexpectedCharacter(current);
+                    continue;
+                }
+                type = T_NOT_EQUAL;
+                length = 2;
+                break;
+            default:
+                unexpectedCharacter(current);
+                continue;
+            }
+            pos += length;
+            return Token{type, start, length};
+        }
+    }
+
+    // Continues scanning at offset. Starting anywhere but the start of src,
+    // a token or whitespace can split a token, so callers that scan from
+    // arbitrary offsets must check where the result lines up with a scan
+    // from the start (see parallel_lexer.h).
+    void seek(size_t offset)
+    {
+        pos = std::min(offset, src.size());
+    }
+
+    // Batch interface: the whole token stream, ending with T_EOF
+    std::vector<Token> tokenize()
+    {
+        std::vector<Token> tokens;
+        do
+        {
+            tokens.push_back(nextToken());
+        } while (tokens.back().type != T_EOF);
+        return tokens;
+    }
+
+    void skipWhitespace()
+    {
+        switch (mode)
+        {
+#ifdef LEXER_SIMD
+        case SCAN_AVX2:
+            pos = skipWhitespaceAVX2(src.data(), pos, src.size());
+            break;
+        case SCAN_SSE2:
+            pos = skipWhitespaceSSE2(src.data(), pos, src.size());
+            break;
+#endif
+        default:
+            pos = skipWhitespaceScalar(src.data(), pos, src.size());
+        }
+    }
+
+    std::string_view consumeNumber()
+    {
+        size_t start = pos;
+#ifdef LEXER_SIMD
+        if (mode != SCAN_SCALAR)
+            pos = skipDigitsSSE2(src.data(), pos, src.size());
+        else
+#endif
+            pos = skipDigitsScalar(src.data(), pos, src.size());
+        return src.substr(start, pos - start);
+    }
+
+    std::string_view consumeWord()
+    {
+        size_t start = pos;
+#ifdef LEXER_SIMD
+        if (mode != SCAN_SCALAR)
+            pos = skipAlnumSSE2(src.data(), pos, src.size());
+        else
+#endif
+            pos = skipAlnumScalar(src.data(), pos, src.size());
+        return src.substr(start, pos - start);
+    }
+
+    // Spelling of a token
+    std::string_view text(const Token &token) const
+    {
+        return src.substr(token.offset, token.length);
+    }
+
+    // Line and column of a source offset, e.g. Token::offset
+    SourceLocation location(size_t offset)
+    {
+        return lines.locate(offset);
+    }
+
+    std::string_view source() const
+    {
+        return src;
+    }
+
+    // Characters skipped so far, in source order
+    const std::vector<Diagnostic> &diagnostics() const
+    {
+        return errors;
+    }
+
+    // Identifiers seen so far, by Token::id
+    const Interner &identifiers() const
+    {
+        return names;
+    }
+
+#ifdef PARSER_INSTRUMENTATION
+    // Token counts and lexing time so far
+    const ParseMetrics &metrics() const
+    {
+        return stats;
+    }
+#endif
+
+private:
+    char peekChar(size_t offset) const
+    {
+        return pos + offset < src.size() ? src[pos + offset] : '\0';
+    }
+
+    void unexpectedCharacter(char current)
+    {
+        errors.push_back({DIAG_UNEXPECTED_CHARACTER, pos, std::string("Unexpected character: ") + current, {}});
+        pos++;
+    }
+};
+
+// Bump-pointer allocator for AST nodes. Nodes are carved out of large blocks
+// one after another, so consecutive nodes are contiguous in memory, and the
+// whole tree is released at once with the blocks instead of node by node.
+class Arena
+{
+public:
+    Arena() : current(nullptr), remaining(0), requested(0) {}
+
+    Arena(Arena &&other) noexcept
+        : blocks(std::move(other.blocks)), current(other.current), remaining(other.remaining), requested(other.requested)
+    {
+        other.current = nullptr;
+        other.remaining = 0;
+        other.requested = 0;
+    }
+
+    Arena &operator=(Arena &&other) noexcept
+    {
+        blocks = std::move(other.blocks);
+        current = other.current;
+        remaining = other.remaining;
+        requested = other.requested;
+        other.current = nullptr;
+        other.remaining = 0;
+        other.requested = 0;
+        return *this;
+    }
+
+    // Bytes handed out by allocate() since the arena was made or last
+    // reset(), not counting alignment padding or the unused end of blocks
+    size_t bytesRequested() const
+    {
+        return requested;
+    }
+
+    // Releases every object at once but keeps the first block, so an arena
+    // reused for a run of small parses stops calling the allocator
+    void reset()
+    {
+        if (blocks.empty())
+            return;
+        blocks.resize(1);
+        current = blocks.front().get();
+        remaining = BLOCK_SIZE;
+        requested = 0;
+    }
+
+    // Takes over other's blocks, so that everything allocated from either
+    // arena lives as long as this one
+    void absorb(Arena &&other)
+    {
+        for (std::unique_ptr<char[]> &block : other.blocks)
+            blocks.push_back(std::move(block));
+        requested += other.requested;
+        other.blocks.clear();
+        other.current = nullptr;
+        other.remaining = 0;
+        other.requested = 0;
+    }
+
+    // Objects are never destroyed, only their memory is released
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects must be trivially destructible");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void *allocate(size_t size, size_t align)
+    {
+        size_t padding = -reinterpret_cast<uintptr_t>(current) & (align - 1);
+        if (padding + size > remaining)
+        {
+            grow(size + align);
+            padding = -reinterpret_cast<uintptr_t>(current) & (align - 1);
+        }
+        char *memory = current + padding;
+        current = memory + size;
+        remaining -= padding + size;
+        requested += size;
+        return memory;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *current;
+    size_t remaining;
+    size_t requested;
+
+    void grow(size_t minimum)
+    {
+        size_t size = std::max(BLOCK_SIZE, minimum);
+        blocks.emplace_back(new char[size]);
+        current = blocks.back().get();
+        remaining = size;
+    }
+};
+
+enum NodeKind
+{
+    N_PROGRAM,     // first: statement list
+    N_BLOCK,       // first: statement list
+    N_DECLARATION, // token: declared identifier
+    N_ASSIGNMENT,  // token: assigned identifier, first: value
+    N_IF,          // first: condition, second: then-branch, third: else-branch or null
+    N_WHILE,       // first: condition, second: body
+    N_RETURN,      // first: value
+    N_BINARY,      // token: operator, first: left operand, second: right operand
+    N_NUMBER,      // token: literal
+    N_IDENTIFIER,  // token: name
+    N_ERROR,       // token: where a syntax error was found; stands in for the missing part
+};
+
+// There is no N_FOR: for (init; condition; update) body is parsed as
+// { init; while (condition) { body update } }, with the for token on all
+// three new nodes.
+
+struct Node
+{
+    NodeKind kind;
+    uint32_t slot; // N_DECLARATION, N_ASSIGNMENT, N_IDENTIFIER: the variable's index in ParseResult::slotCount
+    Token token;
+    int64_t value; // N_NUMBER: the literal's value, wrapped to 64 bits
+    Node *first;
+    Node *second;
+    Node *third;
+    Node *next; // Next statement in the enclosing statement list
+
+    Node(NodeKind kind, const Token &token)
+        : kind(kind), slot(0), token(token), value(0), first(nullptr), second(nullptr), third(nullptr), next(nullptr) {}
+};
+
+// The tree produced by Parser::parseProgram(). Tokens in the tree are
+// offsets into source, so the source buffer must outlive the result. The
+// tree is complete even when diagnostics is not empty, with N_ERROR nodes
+// where input was missing or skipped.
+struct ParseResult
+{
+    Arena arena;
+    Node *root;
+    std::vector<Diagnostic> diagnostics; // Lexer and parser errors, ordered by offset
+    std::string_view source;
+    uint32_t slotCount; // Declared variables, numbered densely from 0
+#ifdef PARSER_INSTRUMENTATION
+    ParseMetrics metrics{};
+#endif
+
+    bool ok() const
+    {
+        return diagnostics.empty();
+    }
+
+    // Spelling of a token in the tree
+    std::string_view text(const Token &token) const
+    {
+        return source.substr(token.offset, token.length);
+    }
+};
+
+// Compact copy of the pointer tree, for passes that want to stream over it.
+// Nodes are 32-bit indices into parallel arrays, numbered in preorder, so a
+// pass over the tree walks each array front to back. Children are linked
+// through firstChild/nextSibling in the order of Node's first, second and
+// third pointers (an if without an else has two children). slot and value
+// are Node's. The streaming parser never builds a token array to index
+// into, so a node's token is kept as its type, offset and length; offsets
+// are 32-bit, which limits the flat layout to sources under 4 GB.
+struct FlatAst
+{
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+    std::vector<uint8_t> kind; // NodeKind
+    std::vector<uint32_t> firstChild;
+    std::vector<uint32_t> nextSibling;
+    std::vector<uint32_t> slot;
+    std::vector<int64_t> value;
+    std::vector<uint8_t> tokenType; // TokenType
+    std::vector<uint32_t> tokenOffset;
+    std::vector<uint32_t> tokenLength;
+
+    size_t size() const
+    {
+        return kind.size();
+    }
+
+    // Same shape, slots, values and tokens
+    bool operator==(const FlatAst &other) const
+    {
+        return kind == other.kind && firstChild == other.firstChild && nextSibling == other.nextSibling &&
+               slot == other.slot && value == other.value && tokenType == other.tokenType &&
+               tokenOffset == other.tokenOffset && tokenLength == other.tokenLength;
+    }
+
+    bool operator!=(const FlatAst &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// Converts a parse tree to the flat layout. The walk uses an explicit stack,
+// so arbitrarily deep trees do not overflow the native stack.
+inline FlatAst flatten(const Node *root)
+{
+    FlatAst ast;
+    std::vector<uint32_t> lastChild;
+    std::vector<std::pair<const Node *, uint32_t>> pending{{root, FlatAst::NONE}}; // Node and its parent index
+    std::vector<const Node *> children;
+    while (!pending.empty())
+    {
+        const Node *node = pending.back().first;
+        uint32_t parent = pending.back().second;
+        pending.pop_back();
+
+        uint32_t index = uint32_t(ast.size());
+        ast.kind.push_back(uint8_t(node->kind));
+        ast.firstChild.push_back(FlatAst::NONE);
+        ast.nextSibling.push_back(FlatAst::NONE);
+        ast.slot.push_back(node->slot);
+        ast.value.push_back(node->value);
+        ast.tokenType.push_back(uint8_t(node->token.type));
+        ast.tokenOffset.push_back(uint32_t(node->token.offset));
+        ast.tokenLength.push_back(node->token.length);
+        lastChild.push_back(FlatAst::NONE);
+        if (parent != FlatAst::NONE)
+        {
+            if (lastChild[parent] == FlatAst::NONE)
+                ast.firstChild[parent] = index;
+            else
+                ast.nextSibling[lastChild[parent]] = index;
+            lastChild[parent] = index;
+        }
+
+        children.clear();
+        if (node->kind == N_PROGRAM || node->kind == N_BLOCK)
+        {
+            for (const Node *statement = node->first; statement; statement = statement->next)
+                children.push_back(statement);
+        }
+        else
+        {
+            for (const Node *child : {node->first, node->second, node->third})
+            {
+                if (child)
+                    children.push_back(child);
+            }
+        }
+        for (size_t i = children.size(); i-- > 0;)
+            pending.push_back({children[i], index});
+    }
+    return ast;
+}
+
+// Binding power of each binary operator, indexed by TokenType. Higher binds
+// tighter, and 0 means the token does not continue an expression, so a new
+// operator or level is a one-line change here.
+struct BindingPowers
+{
+    unsigned char power[T_COUNT];
+
+    constexpr BindingPowers() : power()
+    {
+        power[T_LOGICAL_OR] = 1;
+        power[T_LOGICAL_AND] = 2;
+        power[T_EQ] = power[T_NEQ] = power[T_EQUAL] = power[T_NOT_EQUAL] = 3;
+        power[T_GT] = power[T_LT] = power[T_LE] = power[T_GE] = 3;
+        power[T_PLUS] = power[T_MINUS] = 4;
+        power[T_MUL] = power[T_DIV] = 5;
+    }
+};
+
+constexpr BindingPowers bindingPowers;
+
+// Variables in scope while parsing, keyed by Interner id. Each id maps to
+// its innermost declaration, so resolving a name is one array lookup. A
+// declaration saves the binding it shadows on an undo log, and closing the
+// block restores everything logged since it opened. A binding can be
+// implicit: the parser binds an undeclared name where it is first used, so
+// that it is reported once, and a real declaration later in the same block
+// replaces such a binding rather than redeclaring the name.
+class SymbolTable
+{
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+    SymbolTable() : depth(0) {}
+
+    void enterScope()
+    {
+        scopeStarts.push_back(shadowed.size());
+        depth++;
+    }
+
+    void exitScope()
+    {
+        size_t start = scopeStarts.back();
+        scopeStarts.pop_back();
+        while (shadowed.size() > start)
+        {
+            bindings[shadowed.back().first] = shadowed.back().second;
+            shadowed.pop_back();
+        }
+        depth--;
+    }
+
+    // Slot of the innermost declaration of id, or NONE
+    uint32_t lookup(uint32_t id) const
+    {
+        return id < bindings.size() ? bindings[id].slot : NONE;
+    }
+
+    // Whether id was declared in the current block, other than implicitly
+    bool declaredInScope(uint32_t id) const
+    {
+        return lookup(id) != NONE && bindings[id].depth == depth && !bindings[id].implicit;
+    }
+
+    // Blocks open around the current position; 0 is the top level
+    uint32_t scopeDepth() const
+    {
+        return depth;
+    }
+
+    void declare(uint32_t id, uint32_t slot, bool implicit = false)
+    {
+        if (id >= bindings.size())
+            bindings.resize(id + 1, Binding{NONE, 0, false});
+        shadowed.push_back({id, bindings[id]});
+        bindings[id] = Binding{slot, depth, implicit};
+    }
+
+private:
+    struct Binding
+    {
+        uint32_t slot;
+        uint32_t depth; // Block nesting of the declaration; 0 is the top level
+        bool implicit;  // Bound at an undeclared use, not by a declaration
+    };
+
+    std::vector<Binding> bindings; // By id
+    std::vector<std::pair<uint32_t, Binding>> shadowed;
+    std::vector<size_t> scopeStarts; // Length of shadowed when each open block began
+    uint32_t depth;
+};
+
+inline std::string undeclaredMessage(std::string_view name)
+{
+    return "Semantic error: " + std::string(name) + " is not declared";
+}
+
+inline std::string redeclaredMessage(std::string_view name)
+{
+    return "Semantic error: " + std::string(name) + " is already declared in this block";
+}
+
+// A part of a program parsed on its own cannot tell whether a name was
+// declared at the top level before the part began. With
+// Parser::deferTopLevelNames(), such questions are left open: every slot
+// the part numbers is recorded with how it came about, and the caller
+// settles them once the parts before are known (see parallel_parser.h).
+enum SlotOrigin
+{
+    SLOT_LOCAL,      // Declared inside a block: always a new variable
+    SLOT_TOP_LEVEL,  // Declared at the top level: a redeclaration if an earlier part declared the name
+    SLOT_UNRESOLVED, // Used with no declaration in the part: an earlier part's top-level variable, or undeclared and bound on the spot
+};
+
+struct DeferredSlot
+{
+    SlotOrigin origin;
+    Token name;
+    bool report;    // Whether an error here would be reported, i.e. the parser was not panicking
+    uint32_t depth; // SLOT_UNRESOLVED: block nesting at the use
+};
+
+// The top-level statements of one part of a program, with slots numbered
+// from 0 within the part and described by slots
+struct ParsedPart
+{
+    Arena arena;
+    Node *statements;                // Linked through Node::next
+    std::vector<Diagnostic> errors;  // In parse order, offsets only
+    std::vector<DeferredSlot> slots; // By the part's slot number
+    std::vector<Node *> named;       // Every node whose slot is the part's
+#ifdef PARSER_INSTRUMENTATION
+    uint32_t maxStatementDepth = 0;
+    uint32_t maxExpressionDepth = 0;
+#endif
+};
+
+// Parses the tokens of a Lexer, or of any Source with the same nextToken()
+// and text() (parallel_parser.h reads them from an array)
+template <typename Source = Lexer>
+class BasicParser
+{
+public:
+    // The tree is built in arena, which can be one recycled from an earlier
+    // ParseResult (see Arena::reset())
+    BasicParser(Source &lexer, Arena arena = Arena())
+        : lexer(lexer), head(0), count(0), previous(T_EOF), arena(std::move(arena)), statements(nullptr), tail(&statements),
+          panicking(false), slotCount(0), deferring(false) {}
+
+    // Parses the whole input in one pass. A syntax error does not stop the
+    // parse: it is recorded, and the parser skips ahead to the next ';' or
+    // '}' and carries on, so every error in the file is reported at once.
+    ParseResult parseProgram()
+    {
+#ifdef PARSER_INSTRUMENTATION
+        auto start = std::chrono::steady_clock::now();
+#endif
+        Node *program = newNode(N_PROGRAM, peek());
+        parseStatements(SIZE_MAX);
+        program->first = statements;
+
+        std::vector<Diagnostic> all = lexer.diagnostics();
+        all.insert(all.end(), std::make_move_iterator(errors.begin()), std::make_move_iterator(errors.end()));
+        std::stable_sort(all.begin(), all.end(), [](const Diagnostic &a, const Diagnostic &b) {
+            return a.offset < b.offset;
+        });
+        for (Diagnostic &diagnostic : all)
+        {
+            diagnostic.location = lexer.location(diagnostic.offset);
+        }
+#ifdef PARSER_INSTRUMENTATION
+        ParseMetrics metrics = lexer.metrics();
+        metrics.parseSeconds = secondsSince(start);
+        metrics.bytes = lexer.source().size();
+        metrics.maxStatementDepth = maxStatementDepth;
+        metrics.maxExpressionDepth = maxExpressionDepth;
+        metrics.bytesAllocated = arena.bytesRequested();
+        return ParseResult{std::move(arena), program, std::move(all), lexer.source(), slotCount, metrics};
+#else
+        return ParseResult{std::move(arena), program, std::move(all), lexer.source(), slotCount};
+#endif
+    }
+
+    // Piecewise parsing, for a program split into parts at statement
+    // boundaries. Parses top-level statements, as parseProgram() would,
+    // until the next token starts at or after limit.
+    void parseStatements(size_t limit)
+    {
+        while (peek().type != T_EOF && peek().offset < limit)
+        {
+            *tail = parseStatement();
+            tail = &(*tail)->next;
+        }
+    }
+
+    // Offset of the next token
+    size_t position()
+    {
+        return peek().offset;
+    }
+
+    // True after a syntax error until the parser has resynchronized. A part
+    // that ends while recovering may have swallowed the start of the next.
+    bool recovering() const
+    {
+        return panicking;
+    }
+
+    // Leaves top-level names to the caller; see SlotOrigin
+    void deferTopLevelNames()
+    {
+        deferring = true;
+    }
+
+    // Everything parsed so far, for a parser that was never asked to
+    // parseProgram()
+    ParsedPart takePart()
+    {
+        ParsedPart part{std::move(arena), statements, std::move(errors), std::move(deferred), std::move(named)};
+#ifdef PARSER_INSTRUMENTATION
+        part.maxStatementDepth = maxStatementDepth;
+        part.maxExpressionDepth = maxExpressionDepth;
+#endif
+        statements = nullptr;
+        tail = &statements;
+        return part;
+    }
+
+private:
+    // Lookahead ring refilled from the lexer on demand, so only a handful of
+    // tokens are alive at any time regardless of input size
+    static constexpr size_t LOOKAHEAD = 4; // Must be a power of two
+    Source &lexer;
+    Token ring[LOOKAHEAD];
+    size_t head;
+    size_t count;
+    TokenType previous; // Type of the last token consumed
+    Arena arena;
+    Node *statements; // Top-level statements parsed so far
+    Node **tail;
+
+    // Panic mode: after an error, further errors are suppressed until the
+    // parser has resynchronized, since they are usually fallout of the first
+    bool panicking;
+    std::vector<Diagnostic> errors;
+
+    // Every declaration gets a new slot, so a name declared again in an
+    // inner block is a separate variable that shadows the outer one. Uses
+    // resolve to the innermost declaration in scope.
+    SymbolTable symbols;
+    uint32_t slotCount;
+
+    // With deferTopLevelNames(), one entry per slot, and the nodes to
+    // renumber once the caller has settled them
+    bool deferring;
+    std::vector<DeferredSlot> deferred;
+    std::vector<Node *> named;
+
+#ifdef PARSER_INSTRUMENTATION
+    uint32_t maxStatementDepth = 0;
+    uint32_t maxExpressionDepth = 0;
+#endif
+
+    const Token &peek(size_t k = 0)
+    {
+        while (count <= k)
+        {
+            ring[(head + count) & (LOOKAHEAD - 1)] = lexer.nextToken();
+            count++;
+        }
+        return ring[(head + k) & (LOOKAHEAD - 1)];
+    }
+
+    void advance()
+    {
+        previous = peek().type;
+        head = (head + 1) & (LOOKAHEAD - 1);
+        count--;
+    }
+
+    Node *newNode(NodeKind kind, const Token &token)
+    {
+        return arena.make<Node>(kind, token);
+    }
+
+    Node *declareVariable(const Token &name)
+    {
+        Node *node = newNode(N_DECLARATION, name);
+        if (name.type != T_ID)
+        {
+            return node;
+        }
+        if (deferring)
+        {
+            named.push_back(node);
+        }
+        if (symbols.declaredInScope(name.id))
+        {
+            semanticError(DIAG_REDECLARED_VARIABLE, name, redeclaredMessage(lexer.text(name)));
+            node->slot = symbols.lookup(name.id);
+            return node;
+        }
+        node->slot = newSlot(symbols.scopeDepth() == 0 ? SLOT_TOP_LEVEL : SLOT_LOCAL, name);
+        symbols.declare(name.id, node->slot);
+        return node;
+    }
+
+    Node *useVariable(NodeKind kind, const Token &name)
+    {
+        Node *node = newNode(kind, name);
+        if (name.type != T_ID)
+        {
+            return node;
+        }
+        if (deferring)
+        {
+            named.push_back(node);
+        }
+        node->slot = symbols.lookup(name.id);
+        if (node->slot == SymbolTable::NONE)
+        {
+            if (!deferring)
+            {
+                semanticError(DIAG_UNDECLARED_VARIABLE, name, undeclaredMessage(lexer.text(name)));
+            }
+            // Bound on the spot, so the name is reported once per block
+            node->slot = newSlot(SLOT_UNRESOLVED, name);
+            symbols.declare(name.id, node->slot, true);
+        }
+        return node;
+    }
+
+    uint32_t newSlot(SlotOrigin origin, const Token &name)
+    {
+        if (deferring)
+        {
+            deferred.push_back(DeferredSlot{origin, name, !panicking, symbols.scopeDepth()});
+        }
+        return slotCount++;
+    }
+
+    Node *newBinary(const Token &op, Node *left, Node *right)
+    {
+        Node *node = newNode(N_BINARY, op);
+        node->first = left;
+        node->second = right;
+        return node;
+    }
+
+    // Records an error unless in panic mode, or unless one was already
+    // reported at the same token by a frame that has since closed
+    void error(DiagnosticCode code, const Token &at, std::string message)
+    {
+        if (!panicking && (errors.empty() || errors.back().offset != at.offset))
+        {
+            errors.push_back({code, at.offset, std::move(message), {}});
+        }
+        panicking = true;
+    }
+
+    // Records an error that does not disturb parsing, so no panic mode.
+    // While panicking the tokens being parsed are likely misread, so
+    // nothing is reported.
+    void semanticError(DiagnosticCode code, const Token &at, std::string message)
+    {
+        if (!panicking)
+        {
+            errors.push_back({code, at.offset, std::move(message), {}});
+        }
+    }
+
+    Node *unexpectedToken()
+    {
+        error(DIAG_UNEXPECTED_TOKEN, peek(), "Syntax error: unexpected token " + std::string(lexer.text(peek())));
+        return newNode(N_ERROR, peek());
+    }
+
+    // Skips to the next statement boundary: just past a ';' or '}', or just
+    // before a '{', which is never skipped so that braces stay balanced.
+    // Stops early before a '}' so that the enclosing block can still close;
+    // panic mode then ends once that '}' is consumed.
+    void synchronize()
+    {
+        while (previous != T_SEMICOLON && previous != T_RBRACE && peek().type != T_LBRACE)
+        {
+            if (peek().type == T_RBRACE || peek().type == T_EOF)
+            {
+                return;
+            }
+            advance();
+        }
+        panicking = false;
+    }
+
+    // Nesting is tracked on explicit heap stacks rather than the native call
+    // stack, so deeply nested blocks, ifs and parentheses in generated input
+    // cost memory, not a stack overflow. A frame is a statement whose
+    // children are still being parsed.
+    enum FrameState
+    {
+        IN_BLOCK,   // Collecting statements until '}'
+        IN_IF_THEN, // Waiting for the then-branch
+        IN_IF_ELSE, // Waiting for the else-branch
+        IN_WHILE,   // Waiting for the loop body
+        IN_FOR,     // Waiting for the loop body; node is the block wrapping the loop
+    };
+
+    struct Frame
+    {
+        FrameState state;
+        Node *node;
+        Node **tail;  // End of the statement list for IN_BLOCK
+        Node *update; // Update assignment for IN_FOR, run after the body
+    };
+
+    std::vector<Frame> frames;
+    std::vector<Node *> operands;
+    std::vector<Token> operators; // Pending operators and open '('
+
+    Node *parseStatement()
+    {
+        frames.clear();
+        for (;;)
+        {
+            // Open a statement. Blocks, ifs and loops push a frame and go on
+            // to their first child; the others are parsed whole.
+            Node *done = nullptr;
+#ifdef PARSER_INSTRUMENTATION
+            maxStatementDepth = std::max(maxStatementDepth, uint32_t(frames.size() + 1));
+#endif
+            if (panicking)
+            {
+                synchronize();
+            }
+            if (peek().type == T_RBRACE || peek().type == T_EOF)
+            {
+                // Leave the '}' for an enclosing block to close. A stray one
+                // at the top level is consumed so that parsing moves on.
+                done = unexpectedToken();
+                if (frames.empty() && peek().type == T_RBRACE)
+                {
+                    advance();
+                }
+            }
+            else if (peek().type == T_INT)
+            {
+                done = parseDeclaration();
+            }
+            else if (peek().type == T_ID)
+            {
+                done = parseAssignment();
+            }
+            else if (peek().type == T_IF)
+            {
+                Node *statement = newNode(N_IF, expect(T_IF));
+                expect(T_LPAREN);
+                statement->first = parseExpression();
+                expect(T_RPAREN);
+                frames.push_back({IN_IF_THEN, statement, nullptr, nullptr});
+                continue;
+            }
+            else if (peek().type == T_WHILE)
+            {
+                Node *loop = newNode(N_WHILE, expect(T_WHILE));
+                expect(T_LPAREN);
+                loop->first = parseExpression();
+                expect(T_RPAREN);
+                frames.push_back({IN_WHILE, loop, nullptr, nullptr});
+                continue;
+            }
+            else if (peek().type == T_FOR)
+            {
+                Token keyword = expect(T_FOR);
+                expect(T_LPAREN);
+                Node *outer = newNode(N_BLOCK, keyword);
+                Node *loop = newNode(N_WHILE, keyword);
+                outer->first = parseAssignment();
+                outer->first->next = loop;
+                loop->first = parseExpression();
+                expect(T_SEMICOLON);
+                Node *update = parseAssignment(T_RPAREN);
+                loop->second = newNode(N_BLOCK, keyword);
+                frames.push_back({IN_FOR, outer, nullptr, update});
+                continue;
+            }
+            else if (peek().type == T_RETURN)
+            {
+                done = parseReturnStatement();
+            }
+            else if (peek().type == T_LBRACE)
+            {
+                Node *block = newNode(N_BLOCK, expect(T_LBRACE));
+                frames.push_back({IN_BLOCK, block, &block->first, nullptr});
+                symbols.enterScope();
+            }
+            else
+            {
+                done = unexpectedToken();
+                advance();
+            }
+
+            // Hand the finished statement to its parent, closing every
+            // frame it completes, until some frame needs another child
+            for (;;)
+            {
+                if (frames.empty())
+                {
+                    return done;
+                }
+                Frame &frame = frames.back();
+                if (frame.state == IN_BLOCK)
+                {
+                    if (done)
+                    {
+                        *frame.tail = done;
+                        frame.tail = &done->next;
+                    }
+                    if (peek().type != T_RBRACE && peek().type != T_EOF)
+                    {
+                        break;
+                    }
+                    expect(T_RBRACE);
+                    symbols.exitScope();
+                }
+                else if (frame.state == IN_IF_THEN)
+                {
+                    frame.node->second = done;
+                    if (peek().type == T_ELSE)
+                    {
+                        expect(T_ELSE);
+                        frame.state = IN_IF_ELSE;
+                        break;
+                    }
+                }
+                else if (frame.state == IN_IF_ELSE)
+                {
+                    frame.node->third = done;
+                }
+                else if (frame.state == IN_WHILE)
+                {
+                    frame.node->second = done;
+                }
+                else
+                {
+                    Node *body = frame.node->first->next->second;
+                    body->first = done;
+                    done->next = frame.update;
+                }
+                done = frame.node;
+                frames.pop_back();
+            }
+        }
+    }
+
+    Node *parseDeclaration()
+    {
+        expect(T_INT);
+        Node *declaration = declareVariable(expect(T_ID));
+        expect(T_SEMICOLON);
+        return declaration;
+    }
+
+    // terminator is ')' for the update clause of a for
+    Node *parseAssignment(TokenType terminator = T_SEMICOLON)
+    {
+        Node *assignment = useVariable(N_ASSIGNMENT, expect(T_ID));
+        expect(T_ASSIGN);
+        assignment->first = parseExpression();
+        expect(terminator);
+        return assignment;
+    }
+
+    Node *parseReturnStatement()
+    {
+        Node *statement = newNode(N_RETURN, expect(T_RETURN));
+        statement->first = parseExpression();
+        expect(T_SEMICOLON);
+        return statement;
+    }
+
+    // Precedence climbing with explicit operand and operator stacks. Before
+    // an operator is pushed, every pending operator that binds at least as
+    // tightly is folded into a binary node, which keeps each level of the
+    // bindingPowers table left-associative. An open '(' sits on the
+    // operator stack as a barrier until its ')' arrives.
+    Node *parseExpression()
+    {
+        operands.clear();
+        operators.clear();
+        size_t openParens = 0;
+        for (;;)
+        {
+            while (peek().type == T_LPAREN)
+            {
+                operators.push_back(expect(T_LPAREN));
+                openParens++;
+            }
+#ifdef PARSER_INSTRUMENTATION
+            maxExpressionDepth = std::max(maxExpressionDepth, uint32_t(operators.size()));
+#endif
+            operands.push_back(parseOperand());
+
+            int power;
+            while ((power = bindingPowers.power[peek().type]) == 0)
+            {
+                if (peek().type != T_RPAREN || openParens == 0)
+                {
+                    // End of the expression; any '(' still open is missing its ')'
+                    reduceUntilParen();
+                    while (!operators.empty())
+                    {
+                        expect(T_RPAREN);
+                        operators.pop_back();
+                        reduceUntilParen();
+                    }
+                    return operands.back();
+                }
+                reduceUntilParen();
+                operators.pop_back();
+                openParens--;
+                expect(T_RPAREN);
+            }
+            while (!operators.empty() && operators.back().type != T_LPAREN &&
+                   bindingPowers.power[operators.back().type] >= power)
+            {
+                reduce();
+            }
+            operators.push_back(peek());
+            advance();
+#ifdef PARSER_INSTRUMENTATION
+            maxExpressionDepth = std::max(maxExpressionDepth, uint32_t(operators.size()));
+#endif
+        }
+    }
+
+    // Folds the topmost operator and its two operands into one node
+    void reduce()
+    {
+        Node *right = operands.back();
+        operands.pop_back();
+        operands.back() = newBinary(operators.back(), operands.back(), right);
+        operators.pop_back();
+    }
+
+    void reduceUntilParen()
+    {
+        while (!operators.empty() && operators.back().type != T_LPAREN)
+        {
+            reduce();
+        }
+    }
+
+    Node *parseOperand()
+    {
+        if (peek().type == T_NUM)
+        {
+            Node *number = newNode(N_NUMBER, expect(T_NUM));
+            uint64_t value = 0;
+            for (char digit : lexer.text(number->token))
+            {
+                value = value * 10 + uint64_t(digit - '0');
+            }
+            number->value = int64_t(value);
+            return number;
+        }
+        else if (peek().type == T_ID)
+        {
+            return useVariable(N_IDENTIFIER, expect(T_ID));
+        }
+        else
+        {
+            // Not consumed: it may be the ';' or ')' the caller expects next
+            return unexpectedToken();
+        }
+    }
+
+    // Consumes a token of the given type. On a mismatch nothing is consumed
+    // and the token found is returned in its place, so the caller can build
+    // its node and let the statement loop resynchronize.
+    Token expect(TokenType type)
+    {
+        Token token = peek();
+        if (token.type == type)
+        {
+            advance();
+        }
+        else
+        {
+            error(DIAG_EXPECTED_TOKEN, token, "Syntax error: expected " + std::to_string(type) + " but found " + std::string(lexer.text(token)));
+        }
+        return token;
+    }
+};
+
+using Parser = BasicParser<>;
+
+// Parses a whole program. The result refers to source by offset rather
+// than copying it, so source must outlive the result.
+inline ParseResult parse(std::string_view source)
+{
+    Lexer lexer(source);
+    Parser parser(lexer);
+    return parser.parseProgram();
+}
+
+#endif
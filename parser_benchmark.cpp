@@ -0,0 +1,297 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include "parser.h"
+#include "program_generator.h"
+#include "parallel_lexer.h"
+#include "parallel_parser.h"
+#include "pipelined_parser.h"
+#include "incremental_parser.h"
+
+// Throughput of Lexer::tokenize() and Parser::parseProgram() on generated
+// programs (see program_generator.h). Each phase is timed as the best of
+// several rounds and reported in MB/s and tokens/s. parseProgram() pulls
+// its tokens from the lexer as it goes, so the parser's own share is also
+// given, as parseProgram() minus a plain nextToken() loop. ParallelLexer
+// and parseParallel() are timed too, on --threads threads (default: one
+// per core), and so is parsePipelined(), which lexes on a second thread.
+// Edit latency is the mean time IncrementalParser::edit() takes for a
+// one-character insertion or deletion, with the edits spread over the
+// program. Before timing, every parser is checked against parse():
+// IncrementalParser after each of 1000 random edits to a 64 KB
+// program, and again on the full program once the timed edits have
+// undone themselves.
+//
+// --json prints one JSON object per run on a single line, to append to a
+// results file and compare across commits; --label tags it. --write saves
+// the generated program, e.g. to time the older updated_parser_*.cpp
+// executables on the same input.
+//
+// Usage: parser_benchmark [--size MB] [--depth N] [--identifier-length N]
+//                         [--variables N] [--operands N] [--comparisons PERCENT]
+//                         [--logical PERCENT] [--parentheses PERCENT] [--seed N]
+//                         [--rounds N] [--threads N] [--json] [--label TEXT]
+//                         [--write FILE]
+
+using namespace std;
+
+struct Measurement
+{
+    double seconds;
+    double megabytesPerSecond;
+    double tokensPerSecond;
+};
+
+template <typename Run>
+double bestSeconds(Run run, int rounds)
+{
+    double best = 1e30;
+    for (int round = 0; round < rounds; round++)
+    {
+        auto start = chrono::steady_clock::now();
+        run();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+Measurement measure(double seconds, size_t bytes, size_t tokens)
+{
+    return Measurement{seconds, bytes / seconds / 1e6, tokens / seconds};
+}
+
+// Same tree, slots and diagnostics
+bool sameResult(const ParseResult &a, const ParseResult &b)
+{
+    if (flatten(a.root) != flatten(b.root) || a.slotCount != b.slotCount || a.diagnostics.size() != b.diagnostics.size())
+        return false;
+    for (size_t i = 0; i < a.diagnostics.size(); i++)
+    {
+        const Diagnostic &x = a.diagnostics[i], &y = b.diagnostics[i];
+        if (x.code != y.code || x.offset != y.offset || x.message != y.message || x.location.line != y.location.line ||
+            x.location.column != y.location.column)
+            return false;
+    }
+    return true;
+}
+
+string jsonString(const string &text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+string jsonMeasurement(const Measurement &m)
+{
+    return "{\"seconds\":" + to_string(m.seconds) + ",\"mb_per_s\":" + to_string(m.megabytesPerSecond) +
+           ",\"tokens_per_s\":" + to_string(m.tokensPerSecond) + "}";
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions options;
+    options.bytes = 16 << 20;
+    int rounds = 5;
+    size_t threads = thread::hardware_concurrency();
+    bool json = false;
+    string label;
+    const char *writeTo = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (argument == "--json")
+        {
+            json = true;
+            continue;
+        }
+        if (!value)
+        {
+            cerr << "Missing value for " << argument << endl;
+            return 1;
+        }
+        i++;
+        if (argument == "--size")
+            options.bytes = size_t(atof(value) * (1 << 20));
+        else if (argument == "--depth")
+            options.depth = atoi(value);
+        else if (argument == "--identifier-length")
+            options.identifierLength = atoi(value);
+        else if (argument == "--variables")
+            options.variables = max(1, atoi(value));
+        else if (argument == "--operands")
+            options.operands = max(1, atoi(value));
+        else if (argument == "--comparisons")
+            options.comparisonPercent = atoi(value);
+        else if (argument == "--logical")
+            options.logicalPercent = atoi(value);
+        else if (argument == "--parentheses")
+            options.parenthesisPercent = atoi(value);
+        else if (argument == "--seed")
+            options.seed = strtoull(value, nullptr, 10);
+        else if (argument == "--rounds")
+            rounds = max(1, atoi(value));
+        else if (argument == "--threads")
+            threads = max(1, atoi(value));
+        else if (argument == "--label")
+            label = value;
+        else if (argument == "--write")
+            writeTo = value;
+        else
+        {
+            cerr << "Unknown option " << argument << endl;
+            return 1;
+        }
+    }
+
+    string program = ProgramGenerator(options).generate();
+    if (writeTo)
+    {
+        ofstream(writeTo) << program;
+    }
+
+    // Check the input once, outside the timed runs
+    vector<Token> sequential = Lexer(program).tokenize();
+    size_t tokens = sequential.size();
+    TokenizedSource parallel = ParallelLexer(program, threads).tokenize();
+    if (!equal(sequential.begin(), sequential.end(), parallel.tokens.begin(), parallel.tokens.end(), [](const Token &a, const Token &b) {
+            return a.type == b.type && a.offset == b.offset && a.length == b.length && a.id == b.id;
+        }))
+    {
+        cerr << "ParallelLexer disagrees with Lexer::tokenize()" << endl;
+        return 1;
+    }
+    ParseResult checked = parse(program);
+    if (!checked.ok())
+    {
+        const Diagnostic &first = checked.diagnostics.front();
+        cerr << "Generated program does not parse: " << first.message << " at line " << first.location.line << endl;
+        return 1;
+    }
+    FlatAst tree = flatten(checked.root);
+    size_t nodes = tree.size();
+    ParseResult parallelChecked = parseParallel(program, threads);
+    if (!parallelChecked.ok() || flatten(parallelChecked.root) != tree || parallelChecked.slotCount != checked.slotCount)
+    {
+        cerr << "parseParallel() disagrees with parse()" << endl;
+        return 1;
+    }
+    ParseResult pipelinedChecked = parsePipelined(program);
+    if (!pipelinedChecked.ok() || flatten(pipelinedChecked.root) != tree || pipelinedChecked.slotCount != checked.slotCount)
+    {
+        cerr << "parsePipelined() disagrees with parse()" << endl;
+        return 1;
+    }
+    // IncrementalParser is checked after every one of many random edits to
+    // a smaller program, many of them leaving syntax or semantic errors
+    GeneratorOptions editOptions = options;
+    editOptions.bytes = 64 << 10;
+    IncrementalParser edited(ProgramGenerator(editOptions).generate());
+    const size_t CHECKED_EDITS = 1000;
+    mt19937_64 random(options.seed);
+    const char *snippets[] = {"x", " ", "\n", ";", "{", "}", "(", "@", "int x;", "x = 1;", "if (x) { int y; y = x; }"};
+    for (size_t i = 0; i < CHECKED_EDITS; i++)
+    {
+        size_t at = random() % (edited.source().size() + 1);
+        size_t deleted = random() % 4 ? random() % 4 : random() % 64;
+        edited.edit(at, deleted, random() % 4 ? snippets[random() % size(snippets)] : "");
+        string text(edited.source());
+        if (!sameResult(edited.result(), parse(text)))
+        {
+            cerr << "IncrementalParser disagrees with parse() after edit " << i << endl;
+            return 1;
+        }
+    }
+    const size_t EDITS = 64; // Insertions, each undone by a deletion
+    IncrementalParser incremental(program);
+
+    double tokenizeSeconds = bestSeconds([&] {
+        Lexer lexer(program);
+        lexer.tokenize();
+    }, rounds);
+    double parallelSeconds = bestSeconds([&] {
+        ParallelLexer(program, threads).tokenize();
+    }, rounds);
+    double streamSeconds = bestSeconds([&] {
+        Lexer lexer(program);
+        while (lexer.nextToken().type != T_EOF)
+        {
+        }
+    }, rounds);
+    double parseSeconds = bestSeconds([&] {
+        Lexer lexer(program);
+        Parser parser(lexer);
+        parser.parseProgram();
+    }, rounds);
+    double parseParallelSeconds = bestSeconds([&] {
+        parseParallel(program, threads);
+    }, rounds);
+    double parsePipelinedSeconds = bestSeconds([&] {
+        parsePipelined(program);
+    }, rounds);
+    double editSeconds = bestSeconds([&] {
+        for (size_t i = 0; i < EDITS; i++)
+        {
+            size_t at = program.size() * i / EDITS;
+            incremental.edit(at, 0, "x");
+            incremental.edit(at, 1, "");
+        }
+    }, rounds) / (2 * EDITS);
+    if (!sameResult(incremental.result(), checked))
+    {
+        cerr << "IncrementalParser disagrees with parse() after the timed edits" << endl;
+        return 1;
+    }
+
+    Measurement tokenize = measure(tokenizeSeconds, program.size(), tokens);
+    Measurement tokenizeParallel = measure(parallelSeconds, program.size(), tokens);
+    Measurement parseProgram = measure(parseSeconds, program.size(), tokens);
+    Measurement parserOnly = measure(max(parseSeconds - streamSeconds, 1e-9), program.size(), tokens);
+    Measurement parseProgramParallel = measure(parseParallelSeconds, program.size(), tokens);
+    Measurement parseProgramPipelined = measure(parsePipelinedSeconds, program.size(), tokens);
+
+    if (json)
+    {
+        cout << "{\"label\":" << jsonString(label)
+             << ",\"input\":{\"bytes\":" << program.size() << ",\"tokens\":" << tokens << ",\"nodes\":" << nodes
+             << ",\"depth\":" << options.depth << ",\"identifier_length\":" << options.identifierLength
+             << ",\"variables\":" << options.variables << ",\"operands\":" << options.operands
+             << ",\"comparison_percent\":" << options.comparisonPercent << ",\"logical_percent\":" << options.logicalPercent
+             << ",\"parenthesis_percent\":" << options.parenthesisPercent << ",\"seed\":" << options.seed
+             << "},\"rounds\":" << rounds
+             << ",\"tokenize\":" << jsonMeasurement(tokenize)
+             << ",\"threads\":" << threads << ",\"tokenize_parallel\":" << jsonMeasurement(tokenizeParallel)
+             << ",\"parse_program\":" << jsonMeasurement(parseProgram)
+             << ",\"parser_only\":" << jsonMeasurement(parserOnly)
+             << ",\"parse_parallel\":" << jsonMeasurement(parseProgramParallel)
+             << ",\"parse_pipelined\":" << jsonMeasurement(parseProgramPipelined)
+             << ",\"edit_seconds\":" << to_string(editSeconds) << "}" << endl;
+        return 0;
+    }
+
+    cout << "input: " << program.size() / 1e6 << " MB, " << tokens << " tokens, " << nodes << " nodes" << endl;
+    cout << "tokenize():      " << tokenize.seconds * 1e3 << " ms, " << tokenize.megabytesPerSecond << " MB/s, "
+         << tokenize.tokensPerSecond / 1e6 << " M tokens/s" << endl;
+    cout << "ParallelLexer:   " << tokenizeParallel.seconds * 1e3 << " ms, " << tokenizeParallel.megabytesPerSecond << " MB/s, "
+         << tokenizeParallel.tokensPerSecond / 1e6 << " M tokens/s on " << threads << " threads" << endl;
+    cout << "parseProgram():  " << parseProgram.seconds * 1e3 << " ms, " << parseProgram.megabytesPerSecond << " MB/s, "
+         << parseProgram.tokensPerSecond / 1e6 << " M tokens/s (lexing included)" << endl;
+    cout << "  parser only:   " << parserOnly.seconds * 1e3 << " ms, " << parserOnly.megabytesPerSecond << " MB/s, "
+         << parserOnly.tokensPerSecond / 1e6 << " M tokens/s" << endl;
+    cout << "parseParallel(): " << parseProgramParallel.seconds * 1e3 << " ms, " << parseProgramParallel.megabytesPerSecond << " MB/s, "
+         << parseProgramParallel.tokensPerSecond / 1e6 << " M tokens/s on " << threads << " threads" << endl;
+    cout << "parsePipelined(): " << parseProgramPipelined.seconds * 1e3 << " ms, " << parseProgramPipelined.megabytesPerSecond << " MB/s, "
+         << parseProgramPipelined.tokensPerSecond / 1e6 << " M tokens/s (lexing on a second thread)" << endl;
+    cout << "edit():          " << editSeconds * 1e3 << " ms per one-character edit (IncrementalParser)" << endl;
+    return 0;
+}
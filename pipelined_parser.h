@@ -0,0 +1,165 @@
+#ifndef PIPELINED_PARSER_H
+#define PIPELINED_PARSER_H
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "parser.h"
+#include "spsc_ring.h"
+
+// Lexes on a thread of its own, a bounded distance ahead of the parser
+// reading its tokens, so that lexing and parsing overlap and a parse takes
+// about as long as the slower of the two instead of their sum.
+//
+// The producer thread scans BATCH tokens at a time into a local buffer and
+// pushes each batch into an SpscRing; nextToken() pops a batch at a time
+// into a buffer of its own and hands the tokens out from there. Either
+// side that finds the ring full (or empty) yields until the other catches
+// up, so at most CAPACITY tokens are ever buffered, however large the
+// source.
+//
+// The Lexer itself stays on the producer thread: the parser only needs a
+// token's spelling, which text() reads straight from the source. The
+// Lexer's diagnostics, line index and metrics are complete and safe to
+// read once nextToken() has returned T_EOF, after which the producer has
+// exited.
+class PipelinedLexer
+{
+public:
+    static constexpr size_t BATCH = 256;
+    static constexpr size_t CAPACITY = 4096; // Tokens in flight, 96 KB
+
+    // src is not copied and must outlive the PipelinedLexer and every token
+    PipelinedLexer(std::string_view src, ScanMode mode = detectScanMode())
+        : lexer(src, mode), ring(std::make_unique<Ring>()), next(0), filled(0), ended(false), stopping(false)
+    {
+        producer = std::thread([this] {
+            produce();
+        });
+    }
+
+    PipelinedLexer(const PipelinedLexer &) = delete;
+    PipelinedLexer &operator=(const PipelinedLexer &) = delete;
+
+    // A consumer that stops early leaves the producer waiting on a full
+    // ring, so it is told to give up
+    ~PipelinedLexer()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        finish();
+    }
+
+    // Next token, as Lexer::nextToken() would return it; T_EOF from then on
+    Token nextToken()
+    {
+        if (next == filled)
+            refill();
+        return ended && next == filled ? batch[filled - 1] : batch[next++];
+    }
+
+    std::string_view text(const Token &token) const
+    {
+        return lexer.text(token);
+    }
+
+    std::string_view source() const
+    {
+        return lexer.source();
+    }
+
+    // The rest are only complete once nextToken() has returned T_EOF
+
+    SourceLocation location(size_t offset)
+    {
+        finish();
+        return lexer.location(offset);
+    }
+
+    const std::vector<Diagnostic> &diagnostics()
+    {
+        finish();
+        return lexer.diagnostics();
+    }
+
+    const Interner &identifiers()
+    {
+        finish();
+        return lexer.identifiers();
+    }
+
+#ifdef PARSER_INSTRUMENTATION
+    // lexSeconds is the producer's time in Lexer::nextToken()
+    const ParseMetrics &metrics()
+    {
+        finish();
+        return lexer.metrics();
+    }
+#endif
+
+private:
+    using Ring = SpscRing<Token, CAPACITY>;
+
+    Lexer lexer; // Used by the producer until it exits
+    std::unique_ptr<Ring> ring;
+    std::thread producer;
+    Token batch[BATCH]; // Consumer side
+    size_t next, filled;
+    bool ended; // T_EOF is in batch
+    std::atomic<bool> stopping;
+
+    void produce()
+    {
+        Token out[BATCH];
+        for (;;)
+        {
+            size_t count = 0;
+            do
+            {
+                out[count] = lexer.nextToken();
+            } while (out[count++].type != T_EOF && count < BATCH);
+            for (size_t pushed = 0; pushed < count;)
+            {
+                size_t n = ring->push(out + pushed, count - pushed);
+                if (n == 0)
+                {
+                    if (stopping.load(std::memory_order_relaxed))
+                        return;
+                    std::this_thread::yield();
+                }
+                pushed += n;
+            }
+            if (out[count - 1].type == T_EOF)
+                return;
+        }
+    }
+
+    void refill()
+    {
+        if (ended)
+            return;
+        size_t n;
+        while ((n = ring->pop(batch, BATCH)) == 0)
+            std::this_thread::yield();
+        next = 0;
+        filled = n;
+        ended = batch[n - 1].type == T_EOF;
+    }
+
+    void finish()
+    {
+        if (producer.joinable())
+            producer.join();
+    }
+};
+
+// Parses a whole program with lexing on a second thread; see
+// PipelinedLexer. The result is the same as parse()'s.
+inline ParseResult parsePipelined(std::string_view source)
+{
+    PipelinedLexer lexer(source);
+    BasicParser<PipelinedLexer> parser(lexer);
+    return parser.parseProgram();
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef PROGRAM_GENERATOR_H
+#define PROGRAM_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic inputs for benchmarking the lexer and parser. Programs are
+// grammar-valid and declare every variable they use, so parse() reports no
+// diagnostics; they are meant to be parsed, not run, and loops may not
+// terminate.
+
+struct GeneratorOptions
+{
+    size_t bytes = 1 << 20;      // Stop adding statements once the program is this long
+    int depth = 4;               // Deepest nesting of blocks, ifs and loops
+    int identifierLength = 6;    // Length of every variable name
+    int variables = 64;          // Distinct names, declared at the top
+    int operands = 8;            // Operands per expression, on average
+    int comparisonPercent = 15;  // Share of operators that are < <= > >= == !=
+    int logicalPercent = 5;      // Share of operators that are && ||
+    int parenthesisPercent = 10; // Chance that an operand opens a parenthesis
+    uint64_t seed = 1;
+};
+
+class ProgramGenerator
+{
+public:
+    ProgramGenerator(const GeneratorOptions &options) : options(options), random(options.seed)
+    {
+        for (int i = 0; i < options.variables; i++)
+            names.push_back(name(i));
+    }
+
+    std::string generate()
+    {
+        std::string program;
+        program.reserve(options.bytes + 256);
+        for (const std::string &variable : names)
+            program += "int " + variable + ";\n";
+        while (program.size() < options.bytes)
+        {
+            statement(program, 0, 0);
+            program += '\n';
+        }
+        program += "return " + names[0] + ";\n";
+        return program;
+    }
+
+private:
+    GeneratorOptions options;
+    std::mt19937_64 random;
+    std::vector<std::string> names;
+
+    int percent()
+    {
+        return int(random() % 100);
+    }
+
+    // 'v' and then the index in base 26, padded with 'a' to the requested
+    // length. No keyword starts with 'v', so no name is one.
+    std::string name(int index) const
+    {
+        std::string digits;
+        do
+        {
+            digits.insert(digits.begin(), char('a' + index % 26));
+            index /= 26;
+        } while (index > 0);
+        int padding = options.identifierLength - 1 - int(digits.size());
+        return "v" + std::string(padding > 0 ? padding : 0, 'a') + digits;
+    }
+
+    const std::string &variable()
+    {
+        return names[random() % names.size()];
+    }
+
+    void expression(std::string &out)
+    {
+        static const char *arithmetic[] = {" + ", " - ", " * ", " / "};
+        static const char *comparison[] = {" < ", " <= ", " > ", " >= ", " == ", " != "};
+        static const char *logical[] = {" && ", " || "};
+        int count = 1 + int(random() % (2 * options.operands - 1));
+        int open = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (i > 0)
+            {
+                int kind = percent();
+                if (kind < options.logicalPercent)
+                    out += logical[random() % 2];
+                else if (kind < options.logicalPercent + options.comparisonPercent)
+                    out += comparison[random() % 6];
+                else
+                    out += arithmetic[random() % 4];
+            }
+            if (i + 1 < count && percent() < options.parenthesisPercent)
+            {
+                out += '(';
+                open++;
+            }
+            if (random() % 2)
+                out += variable();
+            else
+                out += std::to_string(random() % 1000 + 1);
+            if (open > 0 && percent() < 30)
+            {
+                out += ')';
+                open--;
+            }
+        }
+        out.append(open, ')');
+    }
+
+    void assignment(std::string &out, const std::string &target)
+    {
+        out += target;
+        out += " = ";
+        expression(out);
+        out += ';';
+    }
+
+    void indent(std::string &out, int level)
+    {
+        out.append(4 * level, ' ');
+    }
+
+    // Mostly assignments. Compound statements only start below the depth
+    // limit and while the program is short of its size, since nested
+    // bodies otherwise multiply with depth.
+    void statement(std::string &out, int level, int nesting)
+    {
+        int kind = nesting < options.depth && out.size() < options.bytes ? percent() : 0;
+        indent(out, level);
+        if (kind < 60)
+        {
+            assignment(out, variable());
+        }
+        else if (kind < 75)
+        {
+            out += "if (";
+            expression(out);
+            out += ")\n";
+            block(out, level, nesting + 1);
+            if (random() % 2)
+            {
+                out += '\n';
+                indent(out, level);
+                out += "else\n";
+                block(out, level, nesting + 1);
+            }
+        }
+        else if (kind < 83)
+        {
+            out += "while (";
+            expression(out);
+            out += ")\n";
+            block(out, level, nesting + 1);
+        }
+        else if (kind < 91)
+        {
+            const std::string &counter = variable();
+            out += "for (" + counter + " = 0; " + counter + " < ";
+            expression(out);
+            out += "; " + counter + " = " + counter + " + 1)\n";
+            block(out, level, nesting + 1);
+        }
+        else
+        {
+            // A block that shadows a name
+            const std::string &shadowed = variable();
+            out += "{\n";
+            indent(out, level + 1);
+            out += "int " + shadowed + ";\n";
+            body(out, level + 1, nesting + 1);
+            indent(out, level);
+            out += '}';
+        }
+    }
+
+    void block(std::string &out, int level, int nesting)
+    {
+        indent(out, level);
+        out += "{\n";
+        body(out, level + 1, nesting);
+        indent(out, level);
+        out += '}';
+    }
+
+    void body(std::string &out, int level, int nesting)
+    {
+        int statements = 1 + int(random() % 4);
+        for (int i = 0; i < statements; i++)
+        {
+            statement(out, level, nesting);
+            out += '\n';
+        }
+    }
+};
+
+#endif
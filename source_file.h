@@ -0,0 +1,98 @@
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include <string>
+#include <string_view>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of an input file. Regular files are memory-mapped so the
+// lexer reads straight from the page cache; pipes, devices and stdin ("-")
+// fall back to bulk read() calls into a single buffer. Nothing is printed;
+// errorMessage() says why a file could not be opened.
+class SourceFile {
+public:
+    SourceFile(const std::string& filename) : mapped(nullptr), mappedSize(0), ok(false) {
+#ifdef _WIN32
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            error = "Could not open file " + filename;
+            return;
+        }
+        file.seekg(0, std::ios::end);
+        buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        if (!buffer.empty()) file.read(&buffer[0], buffer.size());
+        view = buffer;
+        ok = true;
+#else
+        int fd = filename == "-" ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "Could not open file " + filename;
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                madvise(address, info.st_size, MADV_SEQUENTIAL);
+                mapped = static_cast<const char*>(address);
+                mappedSize = info.st_size;
+                view = std::string_view(mapped, mappedSize);
+                ok = true;
+            }
+        }
+        if (!ok) {
+            ok = readAll(fd);
+            if (!ok) error = "Could not read file " + filename;
+        }
+        if (fd != STDIN_FILENO) close(fd);
+#endif
+    }
+
+    ~SourceFile() {
+#ifndef _WIN32
+        if (mapped) munmap(const_cast<char*>(mapped), mappedSize);
+#endif
+    }
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool isOpen() const { return ok; }
+    std::string_view text() const { return view; }
+    const std::string& errorMessage() const { return error; } // Set when !isOpen()
+
+private:
+    const char *mapped;
+    size_t mappedSize;
+    std::string buffer; // Only used when the input could not be mapped
+    std::string_view view;
+    std::string error;
+    bool ok;
+
+#ifndef _WIN32
+    bool readAll(int fd) {
+        size_t used = 0;
+        buffer.resize(1 << 16);
+        while (true) {
+            if (used == buffer.size()) buffer.resize(buffer.size() * 2);
+            ssize_t count = read(fd, &buffer[used], buffer.size() - used);
+            if (count < 0) return false;
+            if (count == 0) break;
+            used += count;
+        }
+        buffer.resize(used);
+        view = buffer;
+        return true;
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread.
+//
+// Items live in a fixed array used as a ring. head counts the items ever
+// popped and tail the items ever pushed, so the ring holds tail - head
+// items, and each counter is written by one side only. A side publishes a
+// whole batch with a single release store and sees the other side's with
+// an acquire load, which also makes the items in the batch visible.
+//
+// Each counter sits on its own cache line, next to the owning side's
+// cached copy of the other counter. A side only reloads the other
+// counter when its cached copy says the ring is full (or empty), so in
+// the steady state the two cores trade each line once per batch rather
+// than once per item.
+template <typename T, size_t CAPACITY>
+class SpscRing
+{
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    SpscRing() : head(0), tailSeen(0), tail(0), headSeen(0) {}
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer only: appends up to count items and returns how many fit,
+    // which is 0 while the ring is full
+    size_t push(const T *items, size_t count)
+    {
+        size_t end = tail.load(std::memory_order_relaxed);
+        if (CAPACITY - (end - headSeen) < count)
+            headSeen = head.load(std::memory_order_acquire);
+        size_t n = std::min(count, CAPACITY - (end - headSeen));
+        for (size_t i = 0; i < n; i++)
+            slots[(end + i) & (CAPACITY - 1)] = items[i];
+        tail.store(end + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer only: removes up to most items into out and returns how
+    // many, which is 0 while the ring is empty
+    size_t pop(T *out, size_t most)
+    {
+        size_t start = head.load(std::memory_order_relaxed);
+        if (tailSeen - start < most)
+            tailSeen = tail.load(std::memory_order_acquire);
+        size_t n = std::min(most, tailSeen - start);
+        for (size_t i = 0; i < n; i++)
+            out[i] = slots[(start + i) & (CAPACITY - 1)];
+        head.store(start + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    // Consumer side
+    alignas(64) std::atomic<size_t> head;
+    size_t tailSeen;
+
+    // Producer side
+    alignas(64) std::atomic<size_t> tail;
+    size_t headSeen;
+
+    alignas(64) T slots[CAPACITY];
+};
+
+#endif
@@ -1,9 +1,12 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <cctype>
 #include <map>
+#include "keywords.h"
+#include "source_file.h"
 
 
 // Task1 Turn this code like passing the file name from cmd (Done in lab1) and take that code and pass accordingly.
@@ -18,16 +21,25 @@ enum TokenType {
     T_SEMICOLON, T_GT, T_EOF, 
 };
 
+constexpr Keyword<TokenType> keywordList[] = {
+    {"int", T_INT},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+};
+constexpr auto keywords = makeKeywordTable(keywordList);
+static_assert(keywords.valid(), "no perfect hash for the keyword list");
+
 
 struct Token {
     TokenType type;
-    string value;
+    string_view value; // Points into the source buffer, so the buffer must outlive its tokens
 };
 
 class Lexer {
 
     private:
-        string src;
+        string_view src; // Non-owning, the caller keeps the source alive
         size_t pos;
         /*
         It hold positive values. 
@@ -37,7 +49,7 @@ class Lexer {
         */
 
     public:
-        Lexer(const string &src) {
+        Lexer(string_view src) {
             this->src = src;  
             this->pos = 0;    
         }
@@ -56,47 +68,48 @@ class Lexer {
                     continue;
                 }
                 if (isalpha(current)) {
-                    string word = consumeWord();
-                    if (word == "int") tokens.push_back(Token{T_INT, word});
-                    else if (word == "if") tokens.push_back(Token{T_IF, word});
-                    else if (word == "else") tokens.push_back(Token{T_ELSE, word});
-                    else if (word == "return") tokens.push_back(Token{T_RETURN, word});
-                    else tokens.push_back(Token{T_ID, word});
+                    string_view word = consumeWord();
+                    tokens.push_back(Token{keywords.lookup(word, T_ID), word});
                     continue;
                 }
                 
                 switch (current) {
-                        case '=': tokens.push_back(Token{T_ASSIGN, "="}); break;
-                        case '+': tokens.push_back(Token{T_PLUS, "+"}); break;
-                        case '-': tokens.push_back(Token{T_MINUS, "-"}); break;
-                        case '*': tokens.push_back(Token{T_MUL, "*"}); break;
-                        case '/': tokens.push_back(Token{T_DIV, "/"}); break;
-                        case '(': tokens.push_back(Token{T_LPAREN, "("}); break;
-                        case ')': tokens.push_back(Token{T_RPAREN, ")"}); break;
-                        case '{': tokens.push_back(Token{T_LBRACE, "{"}); break;  
-                        case '}': tokens.push_back(Token{T_RBRACE, "}"}); break;  
-                        case ';': tokens.push_back(Token{T_SEMICOLON, ";"}); break;
-                        case '>': tokens.push_back(Token{T_GT, ">"}); break;
+                        case '=': tokens.push_back(Token{T_ASSIGN, text(1)}); break;
+                        case '+': tokens.push_back(Token{T_PLUS, text(1)}); break;
+                        case '-': tokens.push_back(Token{T_MINUS, text(1)}); break;
+                        case '*': tokens.push_back(Token{T_MUL, text(1)}); break;
+                        case '/': tokens.push_back(Token{T_DIV, text(1)}); break;
+                        case '(': tokens.push_back(Token{T_LPAREN, text(1)}); break;
+                        case ')': tokens.push_back(Token{T_RPAREN, text(1)}); break;
+                        case '{': tokens.push_back(Token{T_LBRACE, text(1)}); break;  
+                        case '}': tokens.push_back(Token{T_RBRACE, text(1)}); break;  
+                        case ';': tokens.push_back(Token{T_SEMICOLON, text(1)}); break;
+                        case '>': tokens.push_back(Token{T_GT, text(1)}); break;
                         default: cout << "Unexpected character: " << current << endl; exit(1);
                 }
                 pos++;
             }
-            tokens.push_back(Token{T_EOF, ""});
+            tokens.push_back(Token{T_EOF, text(0)});
             return tokens;
         }
 
 
-        string consumeNumber() {
+        string_view consumeNumber() {
             size_t start = pos;
             while (pos < src.size() && isdigit(src[pos])) pos++;
             return src.substr(start, pos - start);
         }
 
-        string consumeWord() {
+        string_view consumeWord() {
             size_t start = pos;
             while (pos < src.size() && isalnum(src[pos])) pos++;
             return src.substr(start, pos - start);
         }
+
+        // View of the next length characters of src, used for punctuation tokens
+        string_view text(size_t length) const {
+            return src.substr(pos, length);
+        }
 };
 
 
@@ -218,34 +231,20 @@ private:
     }
 };
 
-void readFileIntoVector(const std::string& filename, std::vector<std::string>& data) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        return; 
-    }
-   std::string line; 
-    while (std::getline(file, line)) {
-        data.push_back(line);  
-    }
-    file.close();
-}
-
 int main(int argc, char* argv[]) 
 {
     if (argc < 2) 
     { 
-        std::cerr << "Usage: " << argv[0] << " <abc.txt>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <abc.txt | ->" << std::endl;
         return 1;
     }
-    std::vector<std::string> data;
-    readFileIntoVector(argv[1], data);
-    std::string combinedInput; 
-    for (const auto& line : data)
-     {
-        combinedInput += line + '\n';
+    SourceFile source(argv[1]);
+    if (!source.isOpen())
+    {
+        std::cerr << "Error: " << source.errorMessage() << std::endl;
+        return 1;
     }
-    Lexer lexer(combinedInput);  
+    Lexer lexer(source.text());
     std::vector<Token> tokens = lexer.tokenize();
     Parser parser(tokens);
     parser.parseProgram(); 
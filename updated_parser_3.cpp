@@ -1,8 +1,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cctype>
 #include <map>
+#include "keywords.h"
 #include <fstream>
 
 //task 3 Add more data types like float, double, string, bool, char into your language,
@@ -15,9 +17,23 @@ enum TokenType {
     T_SEMICOLON, T_GT, T_EOF,
 };
 
+constexpr Keyword<TokenType> keywordList[] = {
+    {"int", T_INT},
+    {"float", T_FLOAT},
+    {"double", T_DOUBLE},
+    {"string", T_STRING},
+    {"bool", T_BOOL},
+    {"char", T_CHAR},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+};
+constexpr auto keywords = makeKeywordTable(keywordList);
+static_assert(keywords.valid(), "no perfect hash for the keyword list");
+
 struct Token {
     TokenType type;
-    string value;
+    string_view value; // Points into the Lexer's source, so the Lexer must outlive its tokens
     int line; // Line number for error reporting
 };
 
@@ -47,50 +63,46 @@ public:
                 continue;
             }
             if (isalpha(current)) {
-                string word = consumeWord();
-                if (word == "int") tokens.push_back(Token{T_INT, word, line});
-                else if (word == "float") tokens.push_back(Token{T_FLOAT, word, line});
-                else if (word == "double") tokens.push_back(Token{T_DOUBLE, word, line});
-                else if (word == "string") tokens.push_back(Token{T_STRING, word, line});
-                else if (word == "bool") tokens.push_back(Token{T_BOOL, word, line});
-                else if (word == "char") tokens.push_back(Token{T_CHAR, word, line});
-                else if (word == "if") tokens.push_back(Token{T_IF, word, line});
-                else if (word == "else") tokens.push_back(Token{T_ELSE, word, line});
-                else if (word == "return") tokens.push_back(Token{T_RETURN, word, line});
-                else tokens.push_back(Token{T_ID, word, line});
+                string_view word = consumeWord();
+                tokens.push_back(Token{keywords.lookup(word, T_ID), word, line});
                 continue;
             }
             
             switch (current) {
-                case '=': tokens.push_back(Token{T_ASSIGN, "=", line}); break;
-                case '+': tokens.push_back(Token{T_PLUS, "+", line}); break;
-                case '-': tokens.push_back(Token{T_MINUS, "-", line}); break;
-                case '*': tokens.push_back(Token{T_MUL, "*", line}); break;
-                case '/': tokens.push_back(Token{T_DIV, "/", line}); break;
-                case '(': tokens.push_back(Token{T_LPAREN, "(", line}); break;
-                case ')': tokens.push_back(Token{T_RPAREN, ")", line}); break;
-                case '{': tokens.push_back(Token{T_LBRACE, "{", line}); break;  
-                case '}': tokens.push_back(Token{T_RBRACE, "}", line}); break;  
-                case ';': tokens.push_back(Token{T_SEMICOLON, ";", line}); break;
-                case '>': tokens.push_back(Token{T_GT, ">", line}); break;
+                case '=': tokens.push_back(Token{T_ASSIGN, text(1), line}); break;
+                case '+': tokens.push_back(Token{T_PLUS, text(1), line}); break;
+                case '-': tokens.push_back(Token{T_MINUS, text(1), line}); break;
+                case '*': tokens.push_back(Token{T_MUL, text(1), line}); break;
+                case '/': tokens.push_back(Token{T_DIV, text(1), line}); break;
+                case '(': tokens.push_back(Token{T_LPAREN, text(1), line}); break;
+                case ')': tokens.push_back(Token{T_RPAREN, text(1), line}); break;
+                case '{': tokens.push_back(Token{T_LBRACE, text(1), line}); break;  
+                case '}': tokens.push_back(Token{T_RBRACE, text(1), line}); break;  
+                case ';': tokens.push_back(Token{T_SEMICOLON, text(1), line}); break;
+                case '>': tokens.push_back(Token{T_GT, text(1), line}); break;
                 default: cout << "Unexpected character: " << current << " at line " << line << endl; exit(1);
             }
             pos++;
         }
-        tokens.push_back(Token{T_EOF, "", line});
+        tokens.push_back(Token{T_EOF, text(0), line});
         return tokens;
     }
 
-    string consumeNumber() {
+    string_view consumeNumber() {
         size_t start = pos;
         while (pos < src.size() && (isdigit(src[pos]) || src[pos] == '.')) pos++;
-        return src.substr(start, pos - start);
+        return string_view(src).substr(start, pos - start);
     }
 
-    string consumeWord() {
+    string_view consumeWord() {
         size_t start = pos;
         while (pos < src.size() && isalnum(src[pos])) pos++;
-        return src.substr(start, pos - start);
+        return string_view(src).substr(start, pos - start);
+    }
+
+    // View of the next length characters of src, used for punctuation tokens
+    string_view text(size_t length) const {
+        return string_view(src).substr(pos, length);
     }
 };
 
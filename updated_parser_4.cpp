@@ -1,8 +1,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cctype>
 #include <map>
+#include "keywords.h"
 
 using namespace std;
 
@@ -16,13 +18,28 @@ enum TokenType {
     T_SEMICOLON, T_EOF, T_FLOAT, T_STRING,
 };
 
+constexpr Keyword<TokenType> keywordList[] = {
+    {"int", T_INT},
+    {"if", T_IF},
+    {"else", T_ELSE},
+    {"return", T_RETURN},
+    {"float", T_FLOAT},
+    {"for", T_FOR},
+    {"while", T_WHILE},
+    {"do", T_DO},
+    {"break", T_BREAK},
+    {"continue", T_CONTINUE},
+};
+constexpr auto keywords = makeKeywordTable(keywordList);
+static_assert(keywords.valid(), "no perfect hash for the keyword list");
+
 struct Token {
     TokenType type;
-    string value;
+    string_view value; // Points into the Lexer's source, so the Lexer must outlive its tokens
     int lineNumber;
     int columnNumber;
     
-    Token(TokenType type, const string& value, int lineNumber, int columnNumber)
+    Token(TokenType type, string_view value, int lineNumber, int columnNumber)
         : type(type), value(value), lineNumber(lineNumber), columnNumber(columnNumber) {}
 };
 
@@ -50,33 +67,23 @@ public:
                 continue;
             }
             if (isalpha(current)) {
-                string word = consumeWord();
-                if (word == "int") tokens.push_back(Token{T_INT, word, lineNumber, columnNumber});
-                else if (word == "if") tokens.push_back(Token{T_IF, word, lineNumber, columnNumber});
-                else if (word == "else") tokens.push_back(Token{T_ELSE, word, lineNumber, columnNumber});
-                else if (word == "return") tokens.push_back(Token{T_RETURN, word, lineNumber, columnNumber});
-                else if (word == "float") tokens.push_back(Token{T_FLOAT, word, lineNumber, columnNumber});
-                else if (word == "for") tokens.push_back(Token{T_FOR, word, lineNumber, columnNumber});
-                else if (word == "while") tokens.push_back(Token{T_WHILE, word, lineNumber, columnNumber});
-                else if (word == "do") tokens.push_back(Token{T_DO, word, lineNumber, columnNumber});
-                else if (word == "break") tokens.push_back(Token{T_BREAK, word, lineNumber, columnNumber});
-                else if (word == "continue") tokens.push_back(Token{T_CONTINUE, word, lineNumber, columnNumber});
-                else tokens.push_back(Token{T_ID, word, lineNumber, columnNumber});
+                string_view word = consumeWord();
+                tokens.push_back(Token{keywords.lookup(word, T_ID), word, lineNumber, columnNumber});
                 continue;
             }
 
             switch (current) {
-                case '=': tokens.push_back(Token{T_ASSIGN, "=", lineNumber, columnNumber}); break;
-                case '+': tokens.push_back(Token{T_PLUS, "+", lineNumber, columnNumber}); break;
-                case '-': tokens.push_back(Token{T_MINUS, "-", lineNumber, columnNumber}); break;
-                case '*': tokens.push_back(Token{T_MUL, "*", lineNumber, columnNumber}); break;
-                case '/': tokens.push_back(Token{T_DIV, "/", lineNumber, columnNumber}); break;
-                case '(': tokens.push_back(Token{T_LPAREN, "(", lineNumber, columnNumber}); break;
-                case ')': tokens.push_back(Token{T_RPAREN, ")", lineNumber, columnNumber}); break;
-                case '{': tokens.push_back(Token{T_LBRACE, "{", lineNumber, columnNumber}); break;
-                case '}': tokens.push_back(Token{T_RBRACE, "}", lineNumber, columnNumber}); break;
-                case ';': tokens.push_back(Token{T_SEMICOLON, ";", lineNumber, columnNumber}); break;
-                case '>': tokens.push_back(Token{T_GT, ">", lineNumber, columnNumber}); break;
+                case '=': tokens.push_back(Token{T_ASSIGN, text(1), lineNumber, columnNumber}); break;
+                case '+': tokens.push_back(Token{T_PLUS, text(1), lineNumber, columnNumber}); break;
+                case '-': tokens.push_back(Token{T_MINUS, text(1), lineNumber, columnNumber}); break;
+                case '*': tokens.push_back(Token{T_MUL, text(1), lineNumber, columnNumber}); break;
+                case '/': tokens.push_back(Token{T_DIV, text(1), lineNumber, columnNumber}); break;
+                case '(': tokens.push_back(Token{T_LPAREN, text(1), lineNumber, columnNumber}); break;
+                case ')': tokens.push_back(Token{T_RPAREN, text(1), lineNumber, columnNumber}); break;
+                case '{': tokens.push_back(Token{T_LBRACE, text(1), lineNumber, columnNumber}); break;
+                case '}': tokens.push_back(Token{T_RBRACE, text(1), lineNumber, columnNumber}); break;
+                case ';': tokens.push_back(Token{T_SEMICOLON, text(1), lineNumber, columnNumber}); break;
+                case '>': tokens.push_back(Token{T_GT, text(1), lineNumber, columnNumber}); break;
                 default: 
                     cout << "Unexpected character: " << current << " at line " << lineNumber << ", column " << columnNumber << endl;
                     exit(1);
@@ -84,7 +91,7 @@ public:
             pos++;
             columnNumber++;
         }
-        tokens.push_back(Token{T_EOF, "", lineNumber, columnNumber});
+        tokens.push_back(Token{T_EOF, text(0), lineNumber, columnNumber});
         return tokens;
     }
 
@@ -98,22 +105,27 @@ public:
         pos++;
     }
 
-    string consumeNumber() {
+    string_view consumeNumber() {
         size_t start = pos;
         while (pos < src.size() && isdigit(src[pos])) {
             pos++;
             columnNumber++;
         }
-        return src.substr(start, pos - start);
+        return string_view(src).substr(start, pos - start);
     }
 
-    string consumeWord() {
+    string_view consumeWord() {
         size_t start = pos;
         while (pos < src.size() && isalnum(src[pos])) {
             pos++;
             columnNumber++;
         }
-        return src.substr(start, pos - start);
+        return string_view(src).substr(start, pos - start);
+    }
+
+    // View of the next length characters of src, used for punctuation tokens
+    string_view text(size_t length) const {
+        return string_view(src).substr(pos, length);
     }
 };
 
@@ -1,444 +1,261 @@
 #include <iostream>
-#include <vector>
 #include <string>
-#include <cctype>
-#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include "parser.h"
+#include "source_file.h"
+#include "work_pool.h"
+#include "pipelined_parser.h"
+#include "parallel_parser.h"
 
 using namespace std;
 
-enum TokenType
+// Command-line checker over parse(). With no argument it checks a built-in
+// sample program. Built with -DPARSER_INSTRUMENTATION it also writes the
+// parse's metrics to stderr as one JSON object. --pipeline lexes the file
+// on a second thread while it is parsed (see pipelined_parser.h).
+//
+// Given several files, a directory (searched recursively) or --jobs, it
+// checks them all in batch mode: the files are spread over --jobs threads
+// (default: one per core) and every diagnostic is printed prefixed with
+// its file name, in the order the files were named, with directory
+// contents sorted by path. The exit status is 1 if any file has an error.
+// A file larger than an even share of the batch would keep one thread
+// busy long after the rest run out of files, so such files are checked
+// first, one at a time, each split over all the threads by ParallelParser.
+//
+// Usage: updated_parser_7 [--pipeline] [abc.txt | -]
+//        updated_parser_7 [--jobs N] <file | directory>...
+const char *sampleProgram = R"(
+        int a;
+        a = 5;
+        int b;
+        b = a + 10;
+        if (b > 10 && a == 5) {
+            return b;
+        } else {
+            return 0;
+        }
+        if (a != 5 || b <= 15) {
+            return a;
+        } else {
+            return 1;
+        }
+    )";
+
+struct BatchFile
 {
-    T_INT,
-    T_ID,
-    T_NUM,
-    T_IF,
-    T_ELSE,
-    T_RETURN,
-    T_ASSIGN,
-    T_PLUS,
-    T_MINUS,
-    T_MUL,
-    T_DIV,
-    T_GT,
-    T_LT,
-    T_EQ,
-    T_LE,
-    T_GE,
-    T_NEQ,
-    T_AND,
-    T_OR,
-    T_LPAREN,
-    T_RPAREN,
-    T_LBRACE,
-    T_RBRACE,
-    T_COMMA,
-    T_FOR,
-    T_WHILE,
-    T_DO,
-    T_BREAK,
-    T_CONTINUE,
-    T_SEMICOLON,
-    T_EOF,
-    T_FLOAT,
-    T_STRING,
-    T_LOGICAL_AND, // Add logical AND token
-    T_LOGICAL_OR,  // Add logical OR token
-    T_EQUAL,       // Add equality token
-    T_NOT_EQUAL,   // Add not equal token
+    string path;
+    uintmax_t size;
+    string report; // Diagnostics, one per line, as printed
+    bool ok;
 };
 
-struct Token
-{
-    TokenType type;
-    string value;
-    int lineNumber;
-    int columnNumber;
+// Files smaller than this are never split, however uneven the batch
+const uintmax_t LARGE_FILE = 1 << 20;
 
-    Token(TokenType type, const string &value, int lineNumber, int columnNumber)
-        : type(type), value(value), lineNumber(lineNumber), columnNumber(columnNumber) {}
+// What each worker keeps from one file to the next
+struct BatchWorker
+{
+    Arena arena;
+#ifdef PARSER_INSTRUMENTATION
+    ParseMetrics metrics;
+#endif
 };
 
-class Lexer
+// threads > 1 parses the file with a ParallelParser on that many threads
+static void checkFile(BatchFile &file, BatchWorker &worker, size_t threads = 1)
 {
-private:
-    string src;
-    size_t pos;
-    int lineNumber;
-    int columnNumber;
-
-public:
-    Lexer(const string &src) : src(src), pos(0), lineNumber(1), columnNumber(1) {}
-
-    vector<Token> tokenize()
+#ifdef PARSER_INSTRUMENTATION
+    auto readStart = chrono::steady_clock::now();
+#endif
+    SourceFile source(file.path);
+#ifdef PARSER_INSTRUMENTATION
+    double readSeconds = secondsSince(readStart);
+#endif
+    if (!source.isOpen())
     {
-        vector<Token> tokens;
-        while (pos < src.size())
-        {
-            char current = src[pos];
-
-            if (isspace(current))
-            {
-                handleWhitespace(current);
-                continue;
-            }
-            if (isdigit(current))
-            {
-                tokens.push_back(Token{T_NUM, consumeNumber(), lineNumber, columnNumber});
-                continue;
-            }
-            if (isalpha(current))
-            {
-                string word = consumeWord();
-                if (word == "int")
-                    tokens.push_back(Token{T_INT, word, lineNumber, columnNumber});
-                else if (word == "if")
-                    tokens.push_back(Token{T_IF, word, lineNumber, columnNumber});
-                else if (word == "else")
-                    tokens.push_back(Token{T_ELSE, word, lineNumber, columnNumber});
-                else if (word == "return")
-                    tokens.push_back(Token{T_RETURN, word, lineNumber, columnNumber});
-                else
-                    tokens.push_back(Token{T_ID, word, lineNumber, columnNumber});
-                continue;
-            }
-
-            switch (current)
-            {
-            case '=':
-                tokens.push_back(Token{T_ASSIGN, "=", lineNumber, columnNumber});
-                break;
-            case '+':
-                tokens.push_back(Token{T_PLUS, "+", lineNumber, columnNumber});
-                break;
-            case '-':
-                tokens.push_back(Token{T_MINUS, "-", lineNumber, columnNumber});
-                break;
-            case '*':
-                tokens.push_back(Token{T_MUL, "*", lineNumber, columnNumber});
-                break;
-            case '/':
-                tokens.push_back(Token{T_DIV, "/", lineNumber, columnNumber});
-                break;
-            case '(':
-                tokens.push_back(Token{T_LPAREN, "(", lineNumber, columnNumber});
-                break;
-            case ')':
-                tokens.push_back(Token{T_RPAREN, ")", lineNumber, columnNumber});
-                break;
-            case '{':
-                tokens.push_back(Token{T_LBRACE, "{", lineNumber, columnNumber});
-                break;
-            case '}':
-                tokens.push_back(Token{T_RBRACE, "}", lineNumber, columnNumber});
-                break;
-            case ';':
-                tokens.push_back(Token{T_SEMICOLON, ";", lineNumber, columnNumber});
-                break;
-            case '>':
-                tokens.push_back(Token{T_GT, ">", lineNumber, columnNumber});
-                break;
-
-            // Other cases...
-            case '&':
-                if (src[pos + 1] == '&')
-                {
-                    tokens.push_back(Token{T_LOGICAL_AND, "&&", lineNumber, columnNumber});
-                    pos++; // Skip the next '&'
-                    columnNumber++;
-                }
-                else
-                {
-                    // Handle unexpected character
-                    cout << "Unexpected character: " << current << " at line " << lineNumber << ", column " << columnNumber << endl;
-                    exit(1);
-                }
-                break;
-            case '|':
-                if (src[pos + 1] == '|')
-                {
-                    tokens.push_back(Token{T_LOGICAL_OR, "||", lineNumber, columnNumber});
-                    pos++; // Skip the next '|'
-                    columnNumber++;
-                }
-                else
-                {
-                    // Handle unexpected character
-                    cout << "Unexpected character: " << current << " at line " << lineNumber << ", column " << columnNumber << endl;
-                    exit(1);
-                }
-                break;
-            case '=':
-                if (src[pos + 1] == '=')
-                {
-                    tokens.push_back(Token{T_EQUAL, "==", lineNumber, columnNumber});
-                    pos++; // Skip the next '='
-                    columnNumber++;
-                }
-                else
-                {
-                    tokens.push_back(Token{T_ASSIGN, "=", lineNumber, columnNumber});
-                }
-                break;
-            case '!':
-                if (src[pos + 1] == '=')
-                {
-                    tokens.push_back(Token{T_NOT_EQUAL, "!=", lineNumber, columnNumber});
-                    pos++; // Skip the next '='
-                    columnNumber++;
-                }
-                else
-                {
-                    // Handle unexpected character
-                    cout << "Unexpected character: " << current << " at line " << lineNumber << ", column " << columnNumber << endl;
-                    exit(1);
-                }
-                break;
-                // Other cases...
-
-            default:
-                cout << "Unexpected character: " << current << " at line " << lineNumber << ", column " << columnNumber << endl;
-                exit(1);
-            }
-            pos++;
-            columnNumber++;
-        }
-        tokens.push_back(Token{T_EOF, "", lineNumber, columnNumber});
-        return tokens;
+        file.report = file.path + ": Error: " + source.errorMessage() + "\n";
+        file.ok = false;
+        return;
     }
-
-    void handleWhitespace(char current)
+    ParseResult result;
+    if (threads > 1)
     {
-        if (current == '\n')
-        {
-            lineNumber++;
-            columnNumber = 1;
-        }
-        else
-        {
-            columnNumber++;
-        }
-        pos++;
+        result = parseParallel(source.text(), threads);
     }
-
-    string consumeNumber()
+    else
     {
-        size_t start = pos;
-        while (pos < src.size() && isdigit(src[pos]))
-        {
-            pos++;
-            columnNumber++;
-        }
-        return src.substr(start, pos - start);
+        Lexer lexer(source.text());
+        Parser parser(lexer, std::move(worker.arena));
+        result = parser.parseProgram();
     }
-
-    string consumeWord()
+    for (const Diagnostic &diagnostic : result.diagnostics)
     {
-        size_t start = pos;
-        while (pos < src.size() && isalnum(src[pos]))
-        {
-            pos++;
-            columnNumber++;
-        }
-        return src.substr(start, pos - start);
+        file.report += file.path + ": " + diagnostic.message + " at line " + to_string(diagnostic.location.line) +
+                       ", column " + to_string(diagnostic.location.column) + "\n";
     }
-};
+    file.ok = result.ok();
+#ifdef PARSER_INSTRUMENTATION
+    // As for a single file, page faults on the mapping count as lexing
+    result.metrics.readSeconds = readSeconds;
+    worker.metrics.add(result.metrics);
+#endif
+    worker.arena = std::move(result.arena);
+    worker.arena.reset();
+}
 
-class Parser
+static int checkBatch(const vector<string> &paths, size_t jobs)
 {
-public:
-    Parser(const vector<Token> &tokens) : tokens(tokens), pos(0) {}
-
-    void parseProgram()
+    vector<BatchFile> files;
+    for (const string &path : paths)
     {
-        while (tokens[pos].type != T_EOF)
+        error_code error;
+        if (!filesystem::is_directory(path, error))
         {
-            parseStatement();
+            files.push_back(BatchFile{path, 0, "", true});
+            continue;
         }
-        cout << "Parsing completed successfully! No Syntax Error" << endl;
-    }
-
-private:
-    vector<Token> tokens;
-    size_t pos;
-
-    void parseStatement()
-    {
-        if (tokens[pos].type == T_INT)
-        {
-            parseDeclaration();
-        }
-        else if (tokens[pos].type == T_ID)
-        {
-            parseAssignment();
-        }
-        else if (tokens[pos].type == T_IF)
-        {
-            parseIfStatement();
-        }
-        else if (tokens[pos].type == T_RETURN)
-        {
-            parseReturnStatement();
-        }
-        else if (tokens[pos].type == T_LBRACE)
+        vector<string> found;
+        for (auto it = filesystem::recursive_directory_iterator(path, error); !error && it != filesystem::recursive_directory_iterator(); it.increment(error))
         {
-            parseBlock();
+            if (it->is_regular_file(error))
+                found.push_back(it->path().string());
         }
-        else
+        if (error)
         {
-            cout << "Syntax error: unexpected token " << tokens[pos].value << " at line " << tokens[pos].lineNumber << ", column " << tokens[pos].columnNumber << endl;
-            exit(1);
-        }
-    }
-
-    void parseBlock()
-    {
-        expect(T_LBRACE);
-        while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF)
-        {
-            parseStatement();
-        }
-        expect(T_RBRACE);
-    }
-
-    void parseDeclaration()
-    {
-        expect(T_INT);
-        expect(T_ID);
-        expect(T_SEMICOLON);
-    }
-
-    void parseAssignment()
-    {
-        expect(T_ID);
-        expect(T_ASSIGN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-
-    void parseIfStatement()
-    {
-        expect(T_IF);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-        if (tokens[pos].type == T_ELSE)
-        {
-            expect(T_ELSE);
-            parseStatement();
+            cerr << "Error: cannot read directory " << path << endl;
+            return 1;
         }
+        sort(found.begin(), found.end());
+        for (string &name : found)
+            files.push_back(BatchFile{std::move(name), 0, "", true});
     }
 
-    void parseReturnStatement()
+    // Largest files first, so the longest parses start right away and the
+    // small ones fill in around them
+    vector<size_t> order(files.size());
+    uintmax_t totalSize = 0;
+    for (size_t i = 0; i < files.size(); i++)
     {
-        expect(T_RETURN);
-        parseExpression();
-        expect(T_SEMICOLON);
+        error_code error;
+        files[i].size = filesystem::file_size(files[i].path, error);
+        if (error)
+            files[i].size = 0;
+        totalSize += files[i].size;
+        order[i] = i;
     }
-
-    void parseExpression()
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return files[a].size > files[b].size;
+    });
+
+    WorkStealingPool pool(jobs);
+    vector<BatchWorker> workers(pool.workers());
+    uintmax_t large = max(LARGE_FILE, totalSize / pool.workers());
+    size_t split = 0;
+    while (pool.workers() > 1 && split < order.size() && files[order[split]].size >= large)
+        split++;
+#ifdef PARSER_INSTRUMENTATION
+    auto start = chrono::steady_clock::now();
+#endif
+    for (size_t i = 0; i < split; i++)
+        checkFile(files[order[i]], workers[0], pool.workers());
+    order.erase(order.begin(), order.begin() + split);
+    pool.run(order, [&](size_t task, size_t worker) {
+        checkFile(files[task], workers[worker]);
+    });
+
+    size_t failed = 0;
+    for (const BatchFile &file : files)
     {
-        parseLogicalOr(); // Start with logical OR
+        cout << file.report;
+        failed += !file.ok;
     }
+    cout << files.size() << " files checked, " << failed << " with errors" << endl;
+#ifdef PARSER_INSTRUMENTATION
+    // Phase times are summed over all workers; wall_seconds is the batch
+    ParseMetrics total;
+    for (const BatchWorker &worker : workers)
+        total.add(worker.metrics);
+    string json = total.json();
+    cerr << json.substr(0, json.size() - 1) << ",\"files\":" << files.size() << ",\"jobs\":" << pool.workers()
+         << ",\"wall_seconds\":" << secondsSince(start) << "}" << endl;
+#endif
+    return failed ? 1 : 0;
+}
 
-    void parseLogicalOr()
+int main(int argc, char *argv[])
+{
+    size_t jobs = thread::hardware_concurrency();
+    bool jobsGiven = false;
+    bool pipeline = false;
+    vector<string> paths;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
     {
-        parseLogicalAnd(); // Process logical AND first
-        while (tokens[pos].type == T_LOGICAL_OR)
+        string argument = argv[i];
+        if (argument == "--jobs" && i + 1 < argc)
         {
-            pos++;             // Consume '||'
-            parseLogicalAnd(); // Process the next logical AND
+            jobs = max(1, atoi(argv[++i]));
+            jobsGiven = true;
         }
+        else if (argument == "--pipeline")
+            pipeline = true;
+        else
+            paths.push_back(argument);
     }
-
-    void parseLogicalAnd()
+    error_code error;
+    bool batch = jobsGiven || paths.size() > 1 || (paths.size() == 1 && filesystem::is_directory(paths[0], error));
+    if (batch)
+        usage = paths.empty() || pipeline || find(paths.begin(), paths.end(), "-") != paths.end();
+    if (usage)
     {
-        parseComparison(); // Process comparisons first
-        while (tokens[pos].type == T_LOGICAL_AND)
-        {
-            pos++;             // Consume '&&'
-            parseComparison(); // Process the next comparison
-        }
+        cerr << "Usage: " << argv[0] << " [--pipeline] [abc.txt | -]" << endl;
+        cerr << "       " << argv[0] << " [--jobs N] <file | directory>..." << endl;
+        return 1;
     }
-
-    void parseComparison()
+    if (batch)
     {
-        parseTerm();
-        while (tokens[pos].type == T_EQ || tokens[pos].type == T_NEQ ||
-               tokens[pos].type == T_GT || tokens[pos].type == T_LT ||
-               tokens[pos].type == T_LE || tokens[pos].type == T_GE)
-        {
-            pos++;       // Consume the comparison operator
-            parseTerm(); // Process the next term
-        }
+        return checkBatch(paths, jobs);
     }
 
-    void parseTerm()
+    string_view text = sampleProgram;
+    unique_ptr<SourceFile> file;
+#ifdef PARSER_INSTRUMENTATION
+    auto readStart = chrono::steady_clock::now();
+#endif
+    if (paths.size() == 1)
     {
-        parseFactor();
-        while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV)
+        file = make_unique<SourceFile>(paths[0]);
+        if (!file->isOpen())
         {
-            pos++;
-            parseFactor();
+            cerr << "Error: " << file->errorMessage() << endl;
+            return 1;
         }
+        text = file->text();
     }
-
-    void parseFactor()
+#ifdef PARSER_INSTRUMENTATION
+    double readSeconds = secondsSince(readStart);
+#endif
+
+    ParseResult result = pipeline ? parsePipelined(text) : parse(text);
+#ifdef PARSER_INSTRUMENTATION
+    // A mapped file is read lazily, so its page faults count as lexing
+    result.metrics.readSeconds = readSeconds;
+    cerr << result.metrics.json() << endl;
+#endif
+    for (const Diagnostic &diagnostic : result.diagnostics)
     {
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID)
-        {
-            pos++;
-        }
-        else if (tokens[pos].type == T_LPAREN)
-        {
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN);
-        }
-        else
-        {
-            cout << "Syntax error: unexpected token " << tokens[pos].value << " at line " << tokens[pos].lineNumber << ", column " << tokens[pos].columnNumber << endl;
-            exit(1);
-        }
+        cout << diagnostic.message << " at line " << diagnostic.location.line << ", column " << diagnostic.location.column << endl;
     }
-
-    void expect(TokenType type)
+    if (!result.ok())
     {
-        if (tokens[pos].type == type)
-        {
-            pos++;
-        }
-        else
-        {
-            cout << "Syntax error: expected " << type << " but found " << tokens[pos].value << " at line " << tokens[pos].lineNumber << ", column " << tokens[pos].columnNumber << endl;
-            exit(1);
-        }
+        return 1;
     }
-};
-
-int main() {
-    string input = R"(
-        int a;
-        a = 5;
-        int b;
-        b = a + 10;
-        if (b > 10 && a == 5) {
-            return b;
-        } else {
-            return 0;
-        }
-        if (a != 5 || b <= 15) {
-            return a;
-        } else {
-            return 1;
-        }
-    )";
-
-    Lexer lexer(input);
-    vector<Token> tokens = lexer.tokenize();
-
-    Parser parser(tokens);
-    parser.parseProgram();
+    cout << "Parsing completed successfully! No Syntax Error" << endl;
 
     return 0;
 }
@@ -0,0 +1,96 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <cstddef>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed list of tasks on a group of threads with work stealing.
+//
+// The tasks are dealt round-robin onto one queue per worker, in the order
+// given, so a caller that lists its longest tasks first gets each worker
+// started on a long one. A worker takes tasks from the front of its own
+// queue. When that queue runs dry it steals from the back of another
+// worker's queue, where the shortest tasks are. A worker stuck on one long
+// task therefore never strands the tasks queued behind it.
+//
+// Tasks do not spawn tasks, so a worker that finds every queue empty is
+// done. Each queue has its own lock, which is only contended while
+// stealing.
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(size_t workers = std::thread::hardware_concurrency())
+        : queues(std::max<size_t>(workers, 1)) {}
+
+    size_t workers() const
+    {
+        return queues.size();
+    }
+
+    // Calls run(task, worker) once for every entry of tasks and returns
+    // when all have finished. worker is in [0, workers()), and a worker
+    // runs one task at a time, so run can keep per-worker state indexed by
+    // worker without locking. The calling thread is worker 0.
+    template <typename Run>
+    void run(const std::vector<size_t> &tasks, Run run)
+    {
+        for (size_t i = 0; i < tasks.size(); i++)
+            queues[i % queues.size()].tasks.push_back(tasks[i]);
+        size_t threads = std::min(queues.size(), std::max<size_t>(tasks.size(), 1));
+        auto work = [&](size_t worker) {
+            size_t task;
+            while (take(worker, task) || steal(worker, task))
+                run(task, worker);
+        };
+        std::vector<std::thread> helpers;
+        for (size_t worker = 1; worker < threads; worker++)
+            helpers.emplace_back(work, worker);
+        work(0);
+        for (std::thread &helper : helpers)
+            helper.join();
+    }
+
+private:
+    // Padded to a cache line so that workers polling neighbouring queues
+    // do not share one
+    struct alignas(64) Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<Queue> queues;
+
+    bool take(size_t worker, size_t &task)
+    {
+        Queue &queue = queues[worker];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            return false;
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t thief, size_t &task)
+    {
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &queue = queues[(thief + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (!queue.tasks.empty())
+            {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif